@@ -0,0 +1,110 @@
+/*
+ * aabb.cpp
+ *
+ */
+#include "aabb.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AABB_X86 1
+#endif
+
+// Two boxes of the same size overlap when their corners are less than a
+// width apart across and less than a height apart vertically
+static inline uint64_t overlaps(int x, int y, int width, int height, int32_t bx, int32_t by) {
+    int dx = bx - x, dy = by - y;
+    return dx > -width && dx < width && dy > -height && dy < height;
+}
+
+int overlapMaskScalar(int x, int y, int width, int height, const int32_t* xs, const int32_t* ys, int count, uint64_t* hits) {
+    int total = 0;
+    for (int first = 0; first < count; first += 64) {
+        int n = count - first < 64 ? count - first : 64;
+        uint64_t word = 0;
+        for (int k = 0; k < n; k++) word |= overlaps(x, y, width, height, xs[first + k], ys[first + k]) << k;
+        hits[first / 64] = word;
+        total += __builtin_popcountll(word);
+    }
+    return total;
+}
+
+#ifdef AABB_X86
+
+// SSE2 is part of x86-64, so this needs no check
+__attribute__((target("sse2")))
+static int overlapMaskSse2(int x, int y, int width, int height, const int32_t* xs, const int32_t* ys, int count, uint64_t* hits) {
+    const __m128i vx = _mm_set1_epi32(x), vy = _mm_set1_epi32(y);
+    const __m128i minX = _mm_set1_epi32(-width), maxX = _mm_set1_epi32(width);
+    const __m128i minY = _mm_set1_epi32(-height), maxY = _mm_set1_epi32(height);
+    int total = 0;
+    for (int first = 0; first < count; first += 64) {
+        int n = count - first < 64 ? count - first : 64;
+        uint64_t word = 0;
+        int k = 0;
+        for (; k + 4 <= n; k += 4) {
+            __m128i dx = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(xs + first + k)), vx);
+            __m128i dy = _mm_sub_epi32(_mm_loadu_si128((const __m128i*)(ys + first + k)), vy);
+            __m128i in = _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(dx, minX), _mm_cmplt_epi32(dx, maxX)),
+                                       _mm_and_si128(_mm_cmpgt_epi32(dy, minY), _mm_cmplt_epi32(dy, maxY)));
+            word |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(in)) << k;
+        }
+        for (; k < n; k++) word |= overlaps(x, y, width, height, xs[first + k], ys[first + k]) << k;
+        hits[first / 64] = word;
+        total += __builtin_popcountll(word);
+    }
+    return total;
+}
+
+__attribute__((target("avx2")))
+static int overlapMaskAvx2(int x, int y, int width, int height, const int32_t* xs, const int32_t* ys, int count, uint64_t* hits) {
+    const __m256i vx = _mm256_set1_epi32(x), vy = _mm256_set1_epi32(y);
+    const __m256i minX = _mm256_set1_epi32(-width), maxX = _mm256_set1_epi32(width);
+    const __m256i minY = _mm256_set1_epi32(-height), maxY = _mm256_set1_epi32(height);
+    int total = 0;
+    for (int first = 0; first < count; first += 64) {
+        int n = count - first < 64 ? count - first : 64;
+        uint64_t word = 0;
+        int k = 0;
+        for (; k + 8 <= n; k += 8) {
+            __m256i dx = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(xs + first + k)), vx);
+            __m256i dy = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i*)(ys + first + k)), vy);
+            __m256i in = _mm256_and_si256(_mm256_and_si256(_mm256_cmpgt_epi32(dx, minX), _mm256_cmpgt_epi32(maxX, dx)),
+                                          _mm256_and_si256(_mm256_cmpgt_epi32(dy, minY), _mm256_cmpgt_epi32(maxY, dy)));
+            word |= (uint64_t)(unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(in)) << k;
+        }
+        for (; k < n; k++) word |= overlaps(x, y, width, height, xs[first + k], ys[first + k]) << k;
+        hits[first / 64] = word;
+        total += __builtin_popcountll(word);
+    }
+    return total;
+}
+
+#endif
+
+typedef int (*OverlapKernel)(int, int, int, int, const int32_t*, const int32_t*, int, uint64_t*);
+
+struct KernelChoice {
+    OverlapKernel kernel;
+    const char* name;
+};
+
+static KernelChoice chooseKernel() {
+#ifdef AABB_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return { overlapMaskAvx2, "avx2" };
+    if (__builtin_cpu_supports("sse2")) return { overlapMaskSse2, "sse2" };
+#endif
+    return { overlapMaskScalar, "scalar" };
+}
+
+static const KernelChoice& chosen() {
+    static const KernelChoice choice = chooseKernel();
+    return choice;
+}
+
+int overlapMask(int x, int y, int width, int height, const int32_t* xs, const int32_t* ys, int count, uint64_t* hits) {
+    return chosen().kernel(x, y, width, height, xs, ys, count, hits);
+}
+
+const char* overlapKernelName() {
+    return chosen().name;
+}
@@ -0,0 +1,26 @@
+/*
+ * aabb.h
+ *
+ * Narrow-phase overlap tests for many boxes at once. Coordinates come in
+ * packed arrays, xs[i] and ys[i] for box i, and the answer is a bit mask,
+ * so one compare instruction covers 8 boxes with AVX2 or 4 with SSE2.
+ * The implementation is picked once, from what the CPU supports; other
+ * targets get the scalar loop.
+ */
+
+#ifndef AABB_H_
+#define AABB_H_
+
+#include <cstdint>
+
+// Every box is width x height and anchored at its bottom-left corner.
+// Sets bit i % 64 of hits[i / 64] if box i overlaps the box at (x, y),
+// clears it otherwise; returns how many overlap. hits needs
+// (count + 63) / 64 words.
+int overlapMask(int x, int y, int width, int height, const int32_t* xs, const int32_t* ys, int count, uint64_t* hits);
+// The same, one box at a time; for comparison and for tests
+int overlapMaskScalar(int x, int y, int width, int height, const int32_t* xs, const int32_t* ys, int count, uint64_t* hits);
+// "avx2", "sse2" or "scalar"
+const char* overlapKernelName();
+
+#endif /* AABB_H_ */
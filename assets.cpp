@@ -0,0 +1,129 @@
+/*
+ * assets.cpp
+ *
+ */
+#include "assets.h"
+#include "log.h"
+#include "trace.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static string pcmCacheDir;
+
+// Cache files are machine-local, so the header is written in native byte order.
+// A cache entry is only used if the source file and the mixer's output
+// format are the same as when it was written.
+struct PcmCacheHeader {
+    char magic[4];              // "RHPC"
+    unsigned int version;
+    int frequency;
+    unsigned int format;
+    int channels;
+    long long sourceSize;
+    long long sourceMtime;
+    unsigned int length;        // bytes of PCM that follow
+};
+
+static const unsigned int PCM_CACHE_VERSION = 1;
+
+void setPcmCacheDir(const string& dir) {
+    pcmCacheDir = dir;
+}
+
+static string cachePath(const string& path) {
+    size_t slash = path.find_last_of('/');
+    return pcmCacheDir + "/" + (slash == string::npos ? path : path.substr(slash + 1)) + ".pcm";
+}
+
+// Header a cache entry for `path` must have to be valid now
+static bool expectedHeader(const string& path, PcmCacheHeader& header) {
+    struct stat st;
+    memset(&header, 0, sizeof(header));
+    Uint16 format = 0;
+    if (stat(path.c_str(), &st) != 0 || !Mix_QuerySpec(&header.frequency, &format, &header.channels)) return false;
+    memcpy(header.magic, "RHPC", 4);
+    header.version = PCM_CACHE_VERSION;
+    header.format = format;
+    header.sourceSize = st.st_size;
+    header.sourceMtime = st.st_mtime;
+    return true;
+}
+
+static Mix_Chunk* loadCached(const string& path) {
+    PcmCacheHeader want, have;
+    if (pcmCacheDir.empty() || !expectedHeader(path, want)) return nullptr;
+    FILE* in = fopen(cachePath(path).c_str(), "rb");
+    if (!in) return nullptr;
+    Mix_Chunk* chunk = nullptr;
+    if (fread(&have, sizeof(have), 1, in) == 1) {
+        want.length = have.length;
+        if (memcmp(&want, &have, sizeof(want)) == 0) {
+            Uint8* pcm = (Uint8*)SDL_malloc(have.length);
+            if (pcm && fread(pcm, 1, have.length, in) == have.length) {
+                chunk = Mix_QuickLoad_RAW(pcm, have.length);
+            }
+            if (chunk) {
+                chunk->allocated = 1;   // Mix_FreeChunk frees the samples too
+            } else {
+                SDL_free(pcm);
+            }
+        }
+    }
+    fclose(in);
+    return chunk;
+}
+
+// Written to a temporary file and renamed, so a concurrent launch never reads half an entry
+static void storeCached(const string& path, const Mix_Chunk* chunk) {
+    PcmCacheHeader header;
+    if (pcmCacheDir.empty() || !expectedHeader(path, header)) return;
+    header.length = chunk->alen;
+    mkdir(pcmCacheDir.c_str(), 0755);
+    string target = cachePath(path);
+    string temp = target + ".tmp" + to_string(getpid());
+    FILE* out = fopen(temp.c_str(), "wb");
+    if (!out) return;
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1 && fwrite(chunk->abuf, 1, chunk->alen, out) == chunk->alen;
+    ok = fclose(out) == 0 && ok;
+    if (!ok || rename(temp.c_str(), target.c_str()) != 0) {
+        unlink(temp.c_str());
+        LOG_WARN("Could not cache decoded %s", path.c_str());
+    }
+}
+
+static Mix_Chunk* loadSound(const string& path) {
+    TraceScope trace("load " + path);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    Mix_Chunk* chunk = loadCached(path);
+    bool cached = chunk != nullptr;
+    if (!chunk) {
+        chunk = Mix_LoadWAV(path.c_str());
+        if (!chunk) {
+            LOG_ERROR("Failed to load %s! SDL_mixer Error: %s", path.c_str(), Mix_GetError());
+            return nullptr;
+        }
+        storeCached(path, chunk);
+    }
+    LOG_DEBUG("Loaded %s%s in %lld ms", path.c_str(), cached ? " from cache" : "",
+              (long long)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count());
+    return chunk;
+}
+
+// Music is streamed while it plays, so only the file is opened here
+static Mix_Music* loadMusic(const string& path) {
+    TraceScope trace("open " + path);
+    Mix_Music* music = Mix_LoadMUS(path.c_str());
+    if (!music) LOG_ERROR("Failed to load %s! SDL_mixer Error: %s", path.c_str(), Mix_GetError());
+    return music;
+}
+
+future<Mix_Chunk*> loadSoundAsync(const string& path) {
+    return async(launch::async, loadSound, path);
+}
+
+future<Mix_Music*> loadMusicAsync(const string& path) {
+    return async(launch::async, loadMusic, path);
+}
@@ -0,0 +1,47 @@
+/*
+ * assets.h
+ *
+ * Sound loading off the main thread. Each file is decoded by its own
+ * worker, so the decodes overlap each other and whatever the main thread
+ * is doing (window setup, the console menu). Sound effects are fully
+ * decoded to PCM, which is the slow part of startup; the decoded samples
+ * are kept in an on-disk cache so later launches only read them back.
+ */
+
+#ifndef ASSETS_H_
+#define ASSETS_H_
+
+#include <SDL2/SDL_mixer.h>
+#include <chrono>
+#include <future>
+#include <string>
+using namespace std;
+
+// Sets the directory for decoded PCM; empty disables the cache.
+void setPcmCacheDir(const string& dir);
+// Both need Mix_OpenAudio to have been called. The futures yield nullptr
+// (after logging why) if the file cannot be loaded.
+future<Mix_Chunk*> loadSoundAsync(const string& path);
+future<Mix_Music*> loadMusicAsync(const string& path);
+
+// A sound effect that can be played as soon as its background load is done.
+class LazySound {
+private:
+    future<Mix_Chunk*> pending;
+    Mix_Chunk* chunk;
+public:
+    LazySound() : chunk(nullptr) {}
+    void load(const string& path) { pending = loadSoundAsync(path); }
+    // Never blocks; nullptr while the sound is still loading (or failed to).
+    Mix_Chunk* ready() {
+        if (!chunk && pending.valid() && pending.wait_for(chrono::seconds(0)) == future_status::ready) chunk = pending.get();
+        return chunk;
+    }
+    // Blocks until the load is done, e.g. before freeing the chunk.
+    Mix_Chunk* wait() {
+        if (pending.valid()) chunk = pending.get();
+        return chunk;
+    }
+};
+
+#endif /* ASSETS_H_ */
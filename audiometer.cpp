@@ -0,0 +1,89 @@
+/*
+ * audiometer.cpp
+ *
+ */
+#include "audiometer.h"
+#include <SDL2/SDL_mixer.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+AudioMeter audioMeter;
+
+static long long nowUs() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+AudioMeter::AudioMeter()
+    : enabled(false), bufferFrames(0), frequency(0), numPeriods(0), lastCallbackUs(0), lateCallbacks(0), numDelays(0) {
+    for (int i = 0; i < MAX_CHANNELS; i++) requested[i].store(0);
+}
+
+void AudioMeter::start(int requestedBufferFrames) {
+    Uint16 format;
+    int channels;
+    if (!Mix_QuerySpec(&frequency, &format, &channels) || frequency <= 0) return;
+    bufferFrames = requestedBufferFrames;
+    enabled = true;
+    Mix_SetPostMix(postMix, this);
+}
+
+// Runs on the audio thread once per buffer
+void AudioMeter::postMix(void* meter, unsigned char* stream, int len) {
+    AudioMeter* self = (AudioMeter*)meter;
+    long long now = nowUs();
+    if (self->lastCallbackUs > 0) {
+        long long period = now - self->lastCallbackUs;
+        long long expected = 1000000LL * self->bufferFrames / self->frequency;
+        if (period > expected * 3 / 2) self->lateCallbacks.fetch_add(1, memory_order_relaxed);
+        long long n = self->numPeriods.load(memory_order_relaxed);
+        self->periods[n % MAX_SAMPLES] = period;
+        self->numPeriods.store(n + 1, memory_order_release);
+    }
+    self->lastCallbackUs = now;
+}
+
+// Runs on the audio thread whenever the channel is mixed; only the first call after a play counts
+void AudioMeter::channelMixed(int channel, void* stream, int len, void* meter) {
+    AudioMeter* self = (AudioMeter*)meter;
+    if (channel < 0 || channel >= MAX_CHANNELS) return;
+    long long requestedAt = self->requested[channel].exchange(0, memory_order_relaxed);
+    if (requestedAt == 0) return;
+    long long n = self->numDelays.load(memory_order_relaxed);
+    self->delays[n % MAX_SAMPLES] = nowUs() - requestedAt;
+    self->numDelays.store(n + 1, memory_order_release);
+}
+
+void AudioMeter::onPlay(int channel) {
+    if (!enabled || channel < 0 || channel >= MAX_CHANNELS) return;
+    requested[channel].store(nowUs(), memory_order_relaxed);
+    // effects are removed whenever a channel stops, so register again for every play
+    Mix_RegisterEffect(channel, channelMixed, nullptr, this);
+}
+
+long long AudioMeter::percentile(const long long* samples, long long count, double p) const {
+    int n = count < MAX_SAMPLES ? (int)count : MAX_SAMPLES;
+    if (n == 0) return 0;
+    vector<long long> sorted(samples, samples + n);
+    int k = (int)(p / 100.0 * (n - 1) + 0.5);
+    nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+}
+
+string AudioMeter::summary() const {
+    if (!enabled) return "not measured";
+    long long periodCount = numPeriods.load(memory_order_acquire);
+    long long delayCount = numDelays.load(memory_order_acquire);
+    double bufferMs = 1000.0 * bufferFrames / frequency;
+    char text[320];
+    snprintf(text, sizeof(text),
+             "%d Hz, %d-frame buffer (%.1f ms): callback period p50 %.1f ms p99 %.1f ms, %lld of %lld late; "
+             "play->mix p50 %.1f ms p99 %.1f ms (n=%lld), about %.1f ms more until it is heard",
+             frequency, bufferFrames, bufferMs,
+             percentile(periods, periodCount, 50) / 1000.0, percentile(periods, periodCount, 99) / 1000.0,
+             lateCallbacks.load(memory_order_relaxed), periodCount,
+             percentile(delays, delayCount, 50) / 1000.0, percentile(delays, delayCount, 99) / 1000.0, delayCount,
+             bufferMs);
+    return text;
+}
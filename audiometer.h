@@ -0,0 +1,50 @@
+/*
+ * audiometer.h
+ *
+ * Measures the audio path when --audio-measure=1: how often the mixer
+ * callback really runs compared with the requested buffer, how many
+ * callbacks came late enough to mean an underrun, and how long a sound
+ * waits between Mix_PlayChannel and the callback that first mixes it.
+ * Samples are written from the audio thread into fixed arrays, so the
+ * callbacks never allocate or lock.
+ */
+
+#ifndef AUDIOMETER_H_
+#define AUDIOMETER_H_
+
+#include <atomic>
+#include <string>
+using namespace std;
+
+class AudioMeter {
+public:
+    static const int MAX_SAMPLES = 4096;
+    static const int MAX_CHANNELS = 32;
+private:
+    bool enabled;
+    int bufferFrames;
+    int frequency;
+    long long periods[MAX_SAMPLES];         // microseconds between mixer callbacks
+    atomic<long long> numPeriods;
+    long long lastCallbackUs;               // audio thread only
+    atomic<long long> lateCallbacks;
+    long long delays[MAX_SAMPLES];          // microseconds from play request to first mix
+    atomic<long long> numDelays;
+    atomic<long long> requested[MAX_CHANNELS];
+
+    static void postMix(void* meter, unsigned char* stream, int len);
+    static void channelMixed(int channel, void* stream, int len, void* meter);
+    long long percentile(const long long* samples, long long count, double p) const;
+public:
+    AudioMeter();
+    // Call after Mix_OpenAudio with the buffer size that was asked for.
+    void start(int requestedBufferFrames);
+    bool isEnabled() const { return enabled; }
+    // Call right after Mix_PlayChannel.
+    void onPlay(int channel);
+    string summary() const;
+};
+
+extern AudioMeter audioMeter;
+
+#endif /* AUDIOMETER_H_ */
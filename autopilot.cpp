@@ -0,0 +1,80 @@
+/*
+ * autopilot.cpp
+ *
+ */
+#include "autopilot.h"
+#include <algorithm>
+#include <cstdlib>
+
+static const float LOW_FUEL = 15;
+static const float FULL_ENOUGH = 60;
+
+static bool near(int x, int y, int targetX, int targetY) {
+    return abs(x - targetX) <= 40 && abs(y - targetY) <= 40;
+}
+
+Autopilot::Autopilot(int playerSpeed)
+    : speed(playerSpeed > 0 ? playerSpeed : 1), columns(660 / speed + 1), rows(640 / speed + 1), refuelling(false),
+      cameFrom(columns * rows) {
+    queue.reserve(columns * rows);
+}
+
+bool Autopilot::nearStation(const World& world, int x, int y) const {
+    for (int i = 0; i < 3; i++) {
+        const FuelStation* fs = world.state.getFuelStation(i);
+        if (fs && near(x, y, fs->getX(), fs->getY())) return true;
+    }
+    return false;
+}
+
+bool Autopilot::atGoal(const World& world, int x, int y) const {
+    if (refuelling) return nearStation(world, x, y);
+    const PlayerCar* player = world.player;
+    if (player->isCarrying()) {
+        const Destination* dest = player->getDestination();
+        return dest && dest->isActive() && near(x, y, dest->getX(), dest->getY());
+    }
+    for (int i = 0; i < world.state.getActivePickupItems(); i++) {
+        const PickupItem* p = world.state.getPickupItem(i);
+        if (p && p->isActive() && near(x, y, p->getX(), p->getY())) return true;
+    }
+    return false;
+}
+
+AutopilotMove Autopilot::decide(const World& world) {
+    AutopilotMove move = { 0, 0, false, false };
+    const PlayerCar* player = world.player;
+    if (refuelling && (player->getFuel() >= FULL_ENOUGH || player->getMoney() < 1)) refuelling = false;
+    else if (!refuelling && player->getFuel() < LOW_FUEL && player->getMoney() >= 1) refuelling = true;
+    if (atGoal(world, player->x, player->y)) {
+        if (refuelling) move.refuel = true;
+        else move.action = true;
+        return move;
+    }
+    // breadth-first search from the player to the closest position that is a goal
+    static const int steps[4][2] = { { -1, 0 }, { 1, 0 }, { 0, 1 }, { 0, -1 } };
+    int start = player->x / speed + player->y / speed * columns;
+    fill(cameFrom.begin(), cameFrom.end(), -1);
+    queue.clear();
+    queue.push_back(start);
+    cameFrom[start] = start;
+    for (size_t head = 0; head < queue.size(); head++) {
+        int at = queue[head];
+        int x = at % columns * speed, y = at / columns * speed;
+        if (at != start && atGoal(world, x, y)) {
+            while (cameFrom[at] != start) at = cameFrom[at];
+            move.dx = at % columns - start % columns;
+            move.dy = at / columns - start / columns;
+            return move;
+        }
+        for (int s = 0; s < 4; s++) {
+            int nx = x + steps[s][0] * speed, ny = y + steps[s][1] * speed;
+            if (nx < 0 || nx > 660 || ny < 0 || ny > 640 || !isRoadCell(nx / 40, ny / 40)) continue;
+            int next = nx / speed + ny / speed * columns;
+            if (cameFrom[next] >= 0) continue;
+            cameFrom[next] = at;
+            queue.push_back(next);
+        }
+    }
+    return move;    // nothing reachable; wait
+}
@@ -0,0 +1,40 @@
+/*
+ * autopilot.h
+ *
+ * Plays the game without a person, for headless runs: it drives to the
+ * nearest waiting pickup, then to the destination, and to a fuel station
+ * whenever fuel runs low. Routes are breadth-first searches over the
+ * positions the player can stop on, so it never bumps into a building;
+ * it does not look out for traffic.
+ */
+
+#ifndef AUTOPILOT_H_
+#define AUTOPILOT_H_
+
+#include "world.h"
+#include <vector>
+using namespace std;
+
+// What the player does this tick: a step of (dx, dy) and/or a key
+struct AutopilotMove {
+    int dx, dy;
+    bool refuel;        // Space
+    bool action;        // Enter
+};
+
+class Autopilot {
+private:
+    int speed;
+    int columns, rows;              // stopping positions are multiples of speed
+    bool refuelling;
+    vector<int> cameFrom;           // BFS scratch, indexed by position
+    vector<int> queue;
+
+    bool nearStation(const World& world, int x, int y) const;
+    bool atGoal(const World& world, int x, int y) const;
+public:
+    explicit Autopilot(int playerSpeed);
+    AutopilotMove decide(const World& world);
+};
+
+#endif /* AUTOPILOT_H_ */
@@ -0,0 +1,317 @@
+/*
+ * bench.cpp
+ *
+ * Micro-benchmarks for the drawing primitives and the simulation tick.
+ * Each benchmark is warmed up, then timed over several repetitions; the
+ * median repetition is reported as ns/op and ops/s, with the fastest and
+ * slowest beside it to show the noise. Drawing benchmarks open a hidden
+ * GLUT window, or an offscreen context when there is no display, and
+ * finish the GL pipeline inside the timed region.
+ *
+ *   bench [--reps=N] [--min-ms=MS] [FILTER]
+ */
+#include "world.h"
+#include "aabb.h"
+#include "events.h"
+#include "highscores.h"
+#include "log.h"
+#include "offscreen.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int repetitions = 7;
+static double minRepMs = 50;    // each repetition runs at least this long
+static const char* filter = nullptr;
+
+// Results the compiler has to assume are used
+static volatile long long sink;
+
+static double nowNs() {
+    return (double)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Times `batch`, which performs `opsPerBatch` operations per call
+static void bench(const char* name, long long opsPerBatch, const function<void()>& batch) {
+    if (filter && !strstr(name, filter)) return;
+    // warm up, and find how many batches fill one repetition
+    long long batches = 1;
+    while (true) {
+        double start = nowNs();
+        for (long long i = 0; i < batches; i++) batch();
+        double elapsed = nowNs() - start;
+        if (elapsed >= minRepMs * 1e6) break;
+        batches = elapsed < minRepMs * 1e5 ? batches * 10 : (long long)(batches * minRepMs * 1e6 / elapsed) + 1;
+    }
+    vector<double> perOp;
+    for (int r = 0; r < repetitions; r++) {
+        double start = nowNs();
+        for (long long i = 0; i < batches; i++) batch();
+        perOp.push_back((nowNs() - start) / (batches * opsPerBatch));
+    }
+    sort(perOp.begin(), perOp.end());
+    double median = perOp[perOp.size() / 2];
+    printf("%-34s %12.1f ns/op %14.0f ops/s   [%.1f .. %.1f]\n", name, median, 1e9 / median, perOp.front(), perOp.back());
+    fflush(stdout);
+}
+
+// A fixed world with four traffic cars, as in a real game
+static void makeWorld(World& world) {
+    srand(1);
+    world.populate(generateWorld(), true);
+}
+
+static void simulationBenchmarks() {
+    World world;
+    makeWorld(world);
+    vector<OtherCar>& cars = world.traffic;
+    bench("OtherCar::move", 4, [&]() {
+        for (int i = 0; i < 4; i++) cars[i].move();
+    });
+    bench("collides", 16, [&]() {
+        int hits = 0;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) hits += collides(cars[i], cars[j]);
+        }
+        sink = hits;
+    });
+    // movement, collision checks and respawns for one tick; the player sits still
+    bench("traffic tick", 1, [&]() {
+        world.moveTraffic();
+        world.resolveCollisions();
+        if (gameEvents.pending() > 0) gameEvents.dispatch();
+    });
+    bench("getRandomRoadPosition", 1, []() {
+        sink = getRandomRoadPosition().x;
+    });
+    Position occupied[7];
+    for (int i = 0; i < 7; i++) occupied[i] = getRandomAdjacentBuildingPosition(occupied, i);
+    bench("getRandomAdjacentBuildingPosition", 1, [&]() {
+        sink = getRandomAdjacentBuildingPosition(occupied, 7).x;
+    });
+    bench("OtherCar::resetPosition", 1, [&]() {
+        cars[0].resetPosition(world.player, world.lanes, 0);
+    });
+    bench("generateWorld", 1, []() {
+        sink = generateWorld().numItems;
+    });
+}
+
+// One 20x40 box against 4096 packed positions, and every pair among 1024
+static void overlapBenchmarks() {
+    const int N = 4096;
+    vector<int32_t> xs(N), ys(N);
+    srand(5);
+    for (int i = 0; i < N; i++) {
+        xs[i] = rand() % 680;
+        ys[i] = rand() % 680;
+    }
+    vector<uint64_t> scalar(N / 64), chosen(N / 64);
+    for (int i = 0; i < N; i += 7) {
+        overlapMaskScalar(xs[i], ys[i], 20, 40, xs.data(), ys.data(), N - i % 5, scalar.data());
+        overlapMask(xs[i], ys[i], 20, 40, xs.data(), ys.data(), N - i % 5, chosen.data());
+        if (scalar != chosen) {
+            printf("%s overlap kernel disagrees with the scalar one\n", overlapKernelName());
+            exit(1);
+        }
+    }
+    bench("overlapMaskScalar, 1 vs 4096", N, [&]() {
+        sink = overlapMaskScalar(340, 340, 20, 40, xs.data(), ys.data(), N, scalar.data());
+    });
+    char name[64];
+    snprintf(name, sizeof(name), "overlapMask (%s), 1 vs 4096", overlapKernelName());
+    bench(name, N, [&]() {
+        sink = overlapMask(340, 340, 20, 40, xs.data(), ys.data(), N, chosen.data());
+    });
+    snprintf(name, sizeof(name), "overlapMask (%s), 1024 x 1024", overlapKernelName());
+    bench(name, 1024 * 1024, [&]() {
+        int hits = 0;
+        for (int i = 0; i < 1024; i++) hits += overlapMask(xs[i], ys[i], 20, 40, xs.data(), ys.data(), 1024, chosen.data());
+        sink = hits;
+    });
+}
+
+// The 144-car city 32 times over: enough cars for the job system to split.
+// The copies start stacked, and the lanes let them out one at a time.
+static void makeCity(World& world) {
+    srand(3);
+    WorldLayout layout = generateWorld(144);
+    vector<Position> cars = layout.traffic;
+    for (int copy = 1; copy < 32; copy++) layout.traffic.insert(layout.traffic.end(), cars.begin(), cars.end());
+    world.populate(layout, true);
+}
+
+static void runTicks(World& world, int ticks) {
+    srand(4);
+    for (int t = 0; t < ticks; t++) {
+        world.moveTraffic();
+        world.resolveCollisions();
+        if (gameEvents.pending() > 0) gameEvents.dispatch();
+    }
+}
+
+static void jobBenchmarks() {
+    JobSystem jobs;
+    World single, parallel;
+    makeCity(single);
+    makeCity(parallel);
+    parallel.jobs = &jobs;
+    // the job system must not change a single car
+    runTicks(single, 500);
+    runTicks(parallel, 500);
+    for (size_t i = 0; i < single.traffic.size(); i++) {
+        if (single.traffic[i].x != parallel.traffic[i].x || single.traffic[i].y != parallel.traffic[i].y ||
+            single.player->getScore() != parallel.player->getScore()) {
+            printf("%d threads moved car %d differently from one thread\n", jobs.threadCount(), (int)i);
+            exit(1);
+        }
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "traffic tick, %d cars", (int)single.traffic.size());
+    bench(name, 1, [&]() { runTicks(single, 1); });
+    snprintf(name, sizeof(name), "traffic tick, %d cars, %d threads", (int)parallel.traffic.size(), jobs.threadCount());
+    bench(name, 1, [&]() { runTicks(parallel, 1); });
+}
+
+// The leaderboard is kept sorted by an index rather than sorted on demand,
+// so what a game pays for is inserting a score and reading the first page.
+// A capped store is also checked to keep its file compacted.
+static void highScoreBenchmarks() {
+    char path[] = "/tmp/rush-hour-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return;
+    close(fd);
+    unlink(path);
+    {
+        HighScoreStore store(path);
+        srand(2);
+        HighScore batch[1000];
+        for (int i = 0; i < 1000; i++) {
+            snprintf(batch[i].name, sizeof(batch[i].name), "player%d", i);
+            batch[i].score = rand() % 100000;
+        }
+        for (int i = 0; i < 100; i++) store.addBatch(batch, 1000);
+        int next = 0;
+        bench("HighScoreStore::add (100k stored)", 1, [&]() {
+            store.add("bench", rand() % 100000 + (next++ & 1));
+        });
+        bench("HighScoreStore::top(10)", 1, [&]() {
+            sink = store.top(10).size();
+        });
+        bench("HighScoreStore::rankOf", 1, [&]() {
+            sink = store.rankOf(rand() % 100000);
+        });
+        store.flush();
+    }
+    unlink(path);
+    // a capped store must keep compacting its file back down as scores arrive
+    {
+        const int CAP = 1000;
+        HighScoreStore store(path, CAP);
+        srand(5);
+        HighScore batch[100];
+        int best = 0;
+        for (int round = 0; round < 1000; round++) {
+            for (int i = 0; i < 100; i++) {
+                snprintf(batch[i].name, sizeof(batch[i].name), "player%d", rand() % 5000);
+                batch[i].score = rand() % 100000;
+                best = max(best, batch[i].score);
+            }
+            store.addBatch(batch, 100);
+        }
+        bench("HighScoreStore::add (capped at 1000)", 1, [&]() {
+            store.add("bench", rand() % 100000);
+        });
+        store.flush();
+        struct stat st;
+        HighScoreStore reloaded(path, CAP);
+        if (stat(path, &st) != 0 || st.st_size > HIGHSCORE_HEADER_SIZE + 2 * CAP * HIGHSCORE_RECORD_SIZE ||
+            !reloaded.load() || reloaded.count() != CAP || reloaded.top(1)[0].score < best) {
+            printf("capped high-score file was not compacted: %lld bytes, %d entries\n",
+                   (long long)st.st_size, reloaded.count());
+            exit(1);
+        }
+    }
+    unlink(path);
+}
+
+static void drawingBenchmarks(int argc, char** argv) {
+    // without a display, draw offscreen; GLUT fonts then are not available
+    bool window = getenv("DISPLAY") != nullptr;
+    if (window) {
+        glutInit(&argc, argv);
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
+        glutInitWindowSize(680, 720);
+        glutCreateWindow("bench");
+        glutHideWindow();
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(0, 680, 0, 720, -1, 1);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+    } else if (offscreenOpen(680, 720)) {
+        printf("(no DISPLAY: drawing offscreen with %s, DrawString skipped)\n", offscreenRenderer().c_str());
+    } else {
+        printf("(drawing benchmarks skipped: no DISPLAY and no offscreen context)\n");
+        return;
+    }
+    // 100 primitives per batch, then glFinish so the GPU's share is timed too
+    bench("DrawSquare", 100, []() {
+        for (int i = 0; i < 100; i++) DrawSquare(i * 6, 100, 40, colors[WHITE]);
+        glFinish();
+    });
+    bench("DrawCircle", 100, []() {
+        for (int i = 0; i < 100; i++) DrawCircle(i * 6, 200, 3, colors[BLACK]);
+        glFinish();
+    });
+    bench("DrawRoundRect", 100, []() {
+        for (int i = 0; i < 100; i++) DrawRoundRect(i * 6, 300, 20, 40, colors[VIOLET], 10);
+        glFinish();
+    });
+    if (window) {
+        bench("DrawString", 100, []() {
+            for (int i = 0; i < 100; i++) DrawString(50, 400, "Score=100", colors[RED]);
+            glFinish();
+        });
+    }
+    Roads roads;
+    bench("Roads::drawRoads", 1, [&]() {
+        roads.drawRoads();
+        glFinish();
+    });
+    World world;
+    makeWorld(world);
+    WorldSnapshot snapshot;
+    bench("World::snapshot", 1, [&]() { world.snapshot(snapshot); });
+    bench("WorldSnapshot::draw", 1, [&]() {
+        snapshot.draw();
+        glFinish();
+    });
+    if (!window) offscreenClose();
+}
+
+int main(int argc, char** argv) {
+    int firstArg = 1;
+    for (; firstArg < argc && strncmp(argv[firstArg], "--", 2) == 0; firstArg++) {
+        if (strncmp(argv[firstArg], "--reps=", 7) == 0) repetitions = max(1, atoi(argv[firstArg] + 7));
+        else if (strncmp(argv[firstArg], "--min-ms=", 9) == 0) minRepMs = max(1.0, atof(argv[firstArg] + 9));
+        else {
+            fprintf(stderr, "usage: bench [--reps=N] [--min-ms=MS] [FILTER]\n");
+            return 2;
+        }
+    }
+    if (firstArg < argc) filter = argv[firstArg];
+    logSetLevel(LOG_LEVEL_WARN);
+    printf("%d repetitions of at least %.0f ms each; median [fastest .. slowest] ns/op\n", repetitions, minRepMs);
+    simulationBenchmarks();
+    overlapBenchmarks();
+    jobBenchmarks();
+    highScoreBenchmarks();
+    drawingBenchmarks(argc, argv);
+    return 0;
+}
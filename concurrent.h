@@ -0,0 +1,68 @@
+/*
+ * concurrent.h
+ *
+ * Hand-offs between the simulation thread and the main (GLUT) thread.
+ * TripleBuffer passes whole snapshots from one writer to one reader
+ * without locks: each side owns a slot and they trade the third, so the
+ * writer never waits for a slow frame and the reader always gets the
+ * newest complete snapshot. ConcurrentQueue carries the small, bursty
+ * traffic the other way (key presses) and events back; it takes a lock,
+ * but only for as long as a push or a swap.
+ */
+
+#ifndef CONCURRENT_H_
+#define CONCURRENT_H_
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+using namespace std;
+
+template <class T>
+class TripleBuffer {
+private:
+    static const int FRESH = 4;     // set on the middle index when it holds an unread snapshot
+    T slots[3];
+    int back;                       // writer's slot
+    atomic<int> middle;             // the slot being traded, | FRESH
+    int front;                      // reader's slot
+public:
+    TripleBuffer() : back(0), middle(1), front(2) {}
+    // Writer: the slot to fill. It keeps whatever the slot held before,
+    // so vectors inside T reuse their capacity.
+    T& writeSlot() { return slots[back]; }
+    // Writer: makes the filled slot the newest snapshot
+    void publish() { back = middle.exchange(back | FRESH, memory_order_acq_rel) & 3; }
+    // Reader: switches to the newest snapshot; false if nothing was published since the last call
+    bool update() {
+        if (!(middle.load(memory_order_relaxed) & FRESH)) return false;
+        front = middle.exchange(front, memory_order_acq_rel) & 3;
+        return true;
+    }
+    // Reader: the snapshot picked by the last update()
+    const T& read() const { return slots[front]; }
+};
+
+template <class T>
+class ConcurrentQueue {
+private:
+    mutex lock;
+    vector<T> items;
+public:
+    void push(const T& item) {
+        lock_guard<mutex> guard(lock);
+        items.push_back(item);
+    }
+    void push(const T* first, int count) {
+        lock_guard<mutex> guard(lock);
+        items.insert(items.end(), first, first + count);
+    }
+    // Moves everything queued into out, which is cleared first
+    void drain(vector<T>& out) {
+        out.clear();
+        lock_guard<mutex> guard(lock);
+        items.swap(out);
+    }
+};
+
+#endif /* CONCURRENT_H_ */
@@ -0,0 +1,94 @@
+/*
+ * config.cpp
+ *
+ */
+#include "config.h"
+#include "log.h"
+#include "scoreservice.h"
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+GameConfig config = {
+    20,     // playerSpeed: 200 px/s, about what the old 10 px key-repeat steps gave
+    100,    // tickMs
+    0,      // showOverlay
+    44100,  // audioRate
+    512,    // audioBuffer: 11.6 ms at 44.1 kHz, down from a hard-coded 2048 (46 ms)
+    2,      // audioChannels
+    0,      // audioMeasure
+    DEFAULT_SCORE_SOCKET,
+    "telemetry",
+    "",     // replayFile
+    "pcmcache",
+    "startup-trace.json",
+};
+
+struct IntOption {
+    const char* name;
+    int* value;
+    int min;            // smaller values are rejected and the default kept
+};
+
+static IntOption intOptions[] = {
+    { "player-speed", &config.playerSpeed, 1 },
+    { "tick-ms", &config.tickMs, 1 },
+    { "overlay", &config.showOverlay, 0 },
+    { "audio-rate", &config.audioRate, 1 },
+    { "audio-buffer", &config.audioBuffer, 1 },
+    { "audio-channels", &config.audioChannels, 1 },
+    { "audio-measure", &config.audioMeasure, 0 },
+};
+
+struct StringOption {
+    const char* name;
+    string* value;
+};
+
+static StringOption stringOptions[] = {
+    { "score-socket", &config.scoreSocket },
+    { "telemetry-dir", &config.telemetryDir },
+    { "replay", &config.replayFile },
+    { "pcm-cache", &config.pcmCacheDir },
+    { "startup-trace", &config.startupTrace },
+};
+
+// Length of the option name in "name=value", or 0 if there is no value
+static size_t nameLength(const char* arg) {
+    const char* eq = strchr(arg, '=');
+    return eq ? eq - arg : 0;
+}
+
+void parseConfig(int& argc, char* argv[]) {
+    int kept = 1;
+    for (int i = 1; i < argc; i++) {
+        bool used = false;
+        if (strncmp(argv[i], "--", 2) == 0) {
+            const char* arg = argv[i] + 2;
+            size_t len = nameLength(arg);
+            for (const IntOption& opt : intOptions) {
+                if (len && len == strlen(opt.name) && strncmp(arg, opt.name, len) == 0) {
+                    char* end;
+                    long value = strtol(arg + len + 1, &end, 10);
+                    if (end == arg + len + 1 || *end || value < opt.min || value > INT_MAX) {
+                        LOG_WARN("Ignoring %s: needs a whole number of at least %d, keeping %d", argv[i], opt.min, *opt.value);
+                    } else {
+                        *opt.value = (int)value;
+                    }
+                    used = true;
+                    break;
+                }
+            }
+            for (const StringOption& opt : stringOptions) {
+                if (!used && len && len == strlen(opt.name) && strncmp(arg, opt.name, len) == 0) {
+                    *opt.value = arg + len + 1;
+                    used = true;
+                }
+            }
+            if (!used) LOG_WARN("Unknown option %s passed on", argv[i]);
+        }
+        if (!used) argv[kept++] = argv[i];
+    }
+    argc = kept;
+    argv[argc] = nullptr;
+}
@@ -0,0 +1,35 @@
+/*
+ * config.h
+ *
+ * Run-time settings, overridable from the command line as --name=value.
+ * Numbers that are not numbers, or out of range, are warned about and
+ * leave the default in place.
+ */
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include <string>
+
+struct GameConfig {
+    int playerSpeed;    // pixels moved per simulation tick while an arrow key is held
+    int tickMs;         // length of one simulation tick
+    int showOverlay;    // draw performance numbers over the map (toggle with 'o')
+    int audioRate;      // output sample rate in Hz
+    int audioBuffer;    // frames per mixer callback; smaller is lower latency until it underruns
+    int audioChannels;  // 1 = mono, 2 = stereo
+    int audioMeasure;   // log callback period and play-to-mix latency at exit
+    std::string scoreSocket;    // score service to submit to; empty keeps scores local
+    std::string telemetryDir;   // where session telemetry and replays go; empty disables them
+    std::string replayFile;     // play this replay instead of starting a game
+    std::string pcmCacheDir;    // decoded sound effects are cached here; empty disables it
+    std::string startupTrace;   // Chrome trace of launch up to the first frame; empty disables it
+};
+
+extern GameConfig config;
+
+// Consumes the --name=value options it knows and leaves every other
+// argument (e.g. the ones meant for glutInit) in argv.
+void parseConfig(int& argc, char* argv[]);
+
+#endif /* CONFIG_H_ */
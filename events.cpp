@@ -0,0 +1,33 @@
+/*
+ * events.cpp
+ *
+ */
+#include "events.h"
+
+EventQueue gameEvents;
+
+void EventQueue::push(GameEventType type, int x, int y, int value) {
+    if (count >= CAPACITY) {
+        dropped++;
+        return;
+    }
+    GameEvent& e = events[count++];
+    e.type = type;
+    e.x = x;
+    e.y = y;
+    e.value = value;
+}
+
+bool EventQueue::subscribe(GameEventListener* listener) {
+    if (numListeners >= MAX_LISTENERS) return false;
+    listeners[numListeners++] = listener;
+    return true;
+}
+
+void EventQueue::dispatch() {
+    if (count == 0) return;
+    for (int i = 0; i < numListeners; i++) {
+        listeners[i]->onEvents(events, count);
+    }
+    count = 0;
+}
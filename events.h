@@ -0,0 +1,60 @@
+/*
+ * events.h
+ *
+ * Typed game events. Simulation code only pushes events into the queue,
+ * which is dispatched once per tick; in the game, a listener forwards them
+ * to the main thread, where audio, HUD and logging react once per frame.
+ */
+
+#ifndef EVENTS_H_
+#define EVENTS_H_
+
+enum GameEventType {
+    EVENT_COLLISION,        // player hit a traffic car
+    EVENT_WALL_BUMP,        // player tried to drive into a building
+    EVENT_PICKUP,           // passenger/package picked up
+    EVENT_DROPOFF,          // passenger/package delivered
+    EVENT_REFUEL,           // fuel bought at a station
+    EVENT_REFUEL_FAILED,    // not enough money to refuel
+    EVENT_GAME_OVER,        // value is 1 for a win, 0 otherwise
+    EVENT_TYPE_COUNT
+};
+
+struct GameEvent {
+    GameEventType type;
+    int x, y;      // player position when the event happened
+    int value;     // score change (or outcome for EVENT_GAME_OVER)
+};
+
+// Consumers receive all events pushed since the last drain as one batch.
+class GameEventListener {
+public:
+    virtual ~GameEventListener() {}
+    virtual void onEvents(const GameEvent* events, int count) = 0;
+};
+
+class EventQueue {
+public:
+    static const int CAPACITY = 256;
+    static const int MAX_LISTENERS = 8;
+private:
+    GameEvent events[CAPACITY];
+    int count;
+    int dropped;
+    GameEventListener* listeners[MAX_LISTENERS];
+    int numListeners;
+public:
+    EventQueue() : count(0), dropped(0), numListeners(0) {}
+    // Never blocks or allocates; events beyond CAPACITY in one tick are dropped
+    // and counted.
+    void push(GameEventType type, int x, int y, int value = 0);
+    bool subscribe(GameEventListener* listener);
+    // Hands the pending batch to every listener and empties the queue.
+    void dispatch();
+    int pending() const { return count; }
+    int droppedCount() const { return dropped; }
+};
+
+extern EventQueue gameEvents;
+
+#endif /* EVENTS_H_ */
@@ -2,491 +2,332 @@
 #include <SDL2/SDL_mixer.h>
 #include <GL/glut.h>
 #include "util.h"
+#include "events.h"
+#include "log.h"
+#include "config.h"
+#include "latency.h"
+#include "highscores.h"
+#include "scoreservice.h"
+#include "telemetry.h"
+#include "replay.h"
+#include "assets.h"
+#include "trace.h"
+#include "voices.h"
+#include "audiometer.h"
+#include "world.h"
+#include "concurrent.h"
 #include <iostream>
 #include <string>
 #include <cmath>
 #include <fstream>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
 using namespace std;
 
 // Audio variables
 Mix_Music* gMenuMusic = NULL;
 Mix_Music* gGameMusic = NULL;
-Mix_Chunk* gCollisionSound = NULL;
-Mix_Chunk* gDestinationSound = NULL;
-Mix_Chunk* gRefuellingSound = NULL;
-
-// Struct definitions
-struct HighScore {
-    char name[20];
-    int score;
-};
-
-struct Position {
-    int x, y;
-};
-
-// Class definitions
-class Vehicle {
-public:
-    int x, y;
-    float* color;
-    Vehicle(int startX = 0, int startY = 0, float* startColor = colors[BLACK])
-        : x(startX), y(startY), color(startColor) {}
-    virtual void move() = 0;
-    virtual void draw() const = 0;
-};
-
-// Collision detection function
-bool collides(const Vehicle& v1, const Vehicle& v2) {
-    return v1.x < v2.x + 20 && v1.x + 20 > v2.x &&
-           v1.y < v2.y + 40 && v1.y + 40 > v2.y;
-}
-
-// Helper functions
-bool isRoadCell(int i, int j) {
-    return (i == 0 || i == 4 || i == 8 || i == 12 || i == 16 ||
-            j == 0 || j == 4 || j == 8 || j == 12 || j == 16);
-}
-
-Position getRandomRoadPosition() {
-    while (true) {
-        int i = rand() % 17;
-        int j = rand() % 17;
-        if (isRoadCell(i, j)) {
-            return {i * 40, j * 40};
-        }
-    }
+LazySound gCollisionSound;
+LazySound gDestinationSound;
+LazySound gRefuellingSound;
+VoiceManager voices(MIX_CHANNELS);
+
+// Plays an effect if the voice manager gives it a channel
+void playEffect(SoundEffect effect, LazySound& sound) {
+    Mix_Chunk* chunk = sound.ready();
+    if (!chunk) return;     // still loading
+    int frequency = 0, channels = 0;
+    Uint16 format = 0;
+    if (Mix_QuerySpec(&frequency, &format, &channels) && frequency > 0) {
+        int bytesPerFrame = channels * ((format & 0xFF) / 8);
+        voices.setLength(effect, (int)(1000LL * chunk->alen / ((long long)frequency * bytesPerFrame)));
+    }
+    int channel = voices.request(effect, glutGet(GLUT_ELAPSED_TIME));
+    if (channel >= 0 && Mix_PlayChannel(channel, chunk, 0) >= 0) audioMeter.onPlay(channel);
 }
 
-Position getRandomAdjacentBuildingPosition(const Position* occupied, int count) {
-    while (true) {
-        int i = rand() % 17;
-        int j = rand() % 17;
-        if (!isRoadCell(i, j)) {
-            bool adjacent = (i > 0 && isRoadCell(i - 1, j)) ||
-                           (i < 16 && isRoadCell(i + 1, j)) ||
-                           (j > 0 && isRoadCell(i, j - 1)) ||
-                           (j < 16 && isRoadCell(i, j + 1));
-            if (adjacent) {
-                int x = i * 40, y = j * 40;
-                bool available = true;
-                for (int k = 0; k < count; k++) {
-                    if (occupied[k].x == x && occupied[k].y == y) {
-                        available = false;
-                        break;
-                    }
-                }
-                if (available) return {x, y};
-            }
-        }
-    }
-}
-
-class Roads {
-public:
-    void drawRoads() {
-        for (int i = 0; i < 17; ++i) {
-            for (int j = 0; j < 17; ++j) {
-                if (isRoadCell(i, j)) {
-                    DrawSquare(i * 40, j * 40, 40, colors[WHITE]);
-                }
-            }
-        }
-    }
-};
-
-class FuelStation {
-private:
-    int x, y;
-public:
-    FuelStation(int startX, int startY) : x(startX), y(startY) {}
-    void draw() const { DrawSquare(x, y, 40, colors[ORANGE]); }
-    int getX() const { return x; }
-    int getY() const { return y; }
-};
-
-class PickupItem {
-public:
-    virtual ~PickupItem() {}
-    virtual void draw() const = 0;
-    virtual int getX() const = 0;
-    virtual int getY() const = 0;
-    virtual bool isActive() const = 0;
-    virtual void setActive(bool status) = 0;
-    virtual void setPosition(int newX, int newY) = 0;
-};
-
-class Passenger : public PickupItem {
-private:
-    int x, y;
-    bool active;
-public:
-    Passenger(int startX, int startY) : x(startX), y(startY), active(true) {}
-    void draw() const override {
-        if (active) {
-            DrawCircle(x + 20, y + 30, 5, colors[RED]);
-            DrawLine(x + 20, y + 25, x + 20, y + 10, 2, colors[BLUE]);
-            DrawLine(x + 20, y + 20, x + 15, y + 15, 2, colors[BLUE]);
-            DrawLine(x + 20, y + 20, x + 25, y + 15, 2, colors[BLUE]);
-            DrawLine(x + 20, y + 10, x + 15, y + 5, 2, colors[BLUE]);
-            DrawLine(x + 20, y + 10, x + 25, y + 5, 2, colors[BLUE]);
-        }
-    }
-    int getX() const override { return x; }
-    int getY() const override { return y; }
-    bool isActive() const override { return active; }
-    void setActive(bool status) override { active = status; }
-    void setPosition(int newX, int newY) override { x = newX; y = newY; }
-};
-
-class Box : public PickupItem {
-private:
-    int x, y;
-    bool active;
-public:
-    Box(int startX, int startY) : x(startX), y(startY), active(true) {}
-    void draw() const override {
-        if (active) {
-            DrawSquare(x + 10, y + 10, 20, colors[BROWN]);
-        }
-    }
-    int getX() const override { return x; }
-    int getY() const override { return y; }
-    bool isActive() const override { return active; }
-    void setActive(bool status) override { active = status; }
-    void setPosition(int newX, int newY) override { x = newX; y = newY; }
-};
-
-class Destination {
-private:
-    int x, y;
-    bool active;
-public:
-    Destination(int startX = 0, int startY = 0) : x(startX), y(startY), active(false) {}
-    void draw() const { if (active) DrawSquare(x, y, 40, colors[GREEN]); }
-    void setPosition(int newX, int newY) { x = newX; y = newY; active = true; }
-    int getX() const { return x; }
-    int getY() const { return y; }
-    bool isActive() const { return active; }
-    void setActive(bool status) { active = status; }
-};
-
-class GameState {
-private:
-    PickupItem* pickupItems[4];
-    int activePickupItems;
-    FuelStation* fuelStations[3];
-public:
-    GameState() : activePickupItems(0) {
-        for (int i = 0; i < 4; i++) pickupItems[i] = nullptr;
-        for (int i = 0; i < 3; i++) fuelStations[i] = nullptr;
-    }
-    ~GameState() {
-        for (int i = 0; i < 4; i++) delete pickupItems[i];
-        for (int i = 0; i < 3; i++) delete fuelStations[i];
-    }
-    void setPickupItem(int index, PickupItem* item) { if (index >= 0 && index < 4) pickupItems[index] = item; }
-    PickupItem* getPickupItem(int index) const { if (index >= 0 && index < 4) return pickupItems[index]; return nullptr; }
-    void setActivePickupItems(int count) { if (count >= 0 && count <= 4) activePickupItems = count; }
-    int getActivePickupItems() const { return activePickupItems; }
-    void setFuelStation(int index, FuelStation* station) { if (index >= 0 && index < 3) fuelStations[index] = station; }
-    FuelStation* getFuelStation(int index) const { if (index >= 0 && index < 3) return fuelStations[index]; return nullptr; }
-};
-
-class PlayerCar : public Vehicle {
-protected:
-    float fuel;
-    float money;
-    int score;
+// Global instances
+const int HIGHSCORE_CAPACITY = 10000;  // the file is compacted back to this many once it holds twice as many
+unique_ptr<HighScoreStore> highScores;  // created by loadHighScores
+string playerName;
+World world;                // the simulation thread's once the game starts
+unique_ptr<JobSystem> jobs; // outlives the simulation thread, which is joined at exit
+bool taxiRole = false;
+ReplayRecorder replay;
+
+// Event consumers on the main thread. Events are dispatched every tick on
+// the simulation thread and forwarded through tickEvents; these get what
+// arrived since the last frame, once per frame.
+class AudioEvents : public GameEventListener {
 public:
-    PlayerCar(int startX = 0, int startY = 0, float* startColor = colors[BLACK], float startFuel = 100.0, float startMoney = 0.0)
-        : Vehicle(startX, startY, startColor), fuel(startFuel), money(startMoney), score(0) {}
-    virtual void pickUp() = 0;
-    virtual bool dropOff() = 0;
-    virtual void drawDestination() const {}
-    bool refuel() {
-        if (money >= 1) {
-            setFuel(getFuel() + 2);
-            addMoney(-1);
-            cout << "Refueled! +2 fuel, -1 money." << endl;
-            return true;
-        } else {
-            cout << "Not enough money to refuel!" << endl;
-            return false;
-        }
+    void onEvents(const GameEvent* events, int count) override {
+        // One sound per effect per frame, however many events caused it
+        bool play[EVENT_TYPE_COUNT] = {false};
+        for (int i = 0; i < count; i++) play[events[i].type] = true;
+        if (play[EVENT_COLLISION] || play[EVENT_WALL_BUMP]) playEffect(SOUND_COLLISION, gCollisionSound);
+        if (play[EVENT_DROPOFF]) playEffect(SOUND_DROPOFF, gDestinationSound);
+        if (play[EVENT_REFUEL]) playEffect(SOUND_REFUEL, gRefuellingSound);
     }
-    void move() override {}
-    void draw() const override {
-        DrawRoundRect(x, y, 20, 40, color, 10);
-        DrawCircle(x + 2, y + 4, 3, colors[BLACK]);
-        DrawCircle(x + 2, y + 32, 3, colors[BLACK]);
-        DrawCircle(x + 18, y + 4, 3, colors[BLACK]);
-        DrawCircle(x + 18, y + 32, 3, colors[BLACK]);
-    }
-    float getFuel() const { return fuel; }
-    void setFuel(float newFuel) { fuel = newFuel > 0 ? newFuel : 0; }
-    float getMoney() const { return money; }
-    void setMoney(float newMoney) { money = newMoney > 0 ? newMoney : 0; }
-    void addMoney(float amount) { money += amount; if (money < 0) money = 0; }
-    int getScore() const { return score; }
-    void addScore(int points) { score += points; }
 };
 
-class Taxi : public PlayerCar {
-private:
-    bool hasPassenger;
-    Destination* destination;
-    GameState& gameState;
+class LogEvents : public GameEventListener {
 public:
-    Taxi(int startX, int startY, float* startColor, float startFuel, float startMoney, GameState& gs)
-        : PlayerCar(startX, startY, startColor, startFuel, startMoney), hasPassenger(false), destination(new Destination()), gameState(gs) {}
-    ~Taxi() { delete destination; }
-    void pickUp() override {
-        if (fuel > 0 && !hasPassenger) {
-            for (int i = 0; i < gameState.getActivePickupItems(); i++) {
-                PickupItem* p = gameState.getPickupItem(i);
-                if (p && p->isActive() && abs(x - p->getX()) <= 40 && abs(y - p->getY()) <= 40) {
-                    p->setActive(false);
-                    hasPassenger = true;
-                    Position destPos = getRandomAdjacentBuildingPosition(nullptr, 0);
-                    destination->setPosition(destPos.x, destPos.y);
-                    cout << "Passenger picked up!" << endl;
-                    fuel -= 1;
+    void onEvents(const GameEvent* events, int count) override {
+        bool taxi = taxiRole;
+        for (int i = 0; i < count; i++) {
+            switch (events[i].type) {
+                case EVENT_PICKUP:
+                    LOG_INFO("%s", taxi ? "Passenger picked up!" : "Package picked up!");
                     break;
-                }
-            }
-        }
-    }
-    bool dropOff() override {
-        if (fuel > 0 && hasPassenger && destination->isActive() &&
-            abs(x - destination->getX()) <= 40 && abs(y - destination->getY()) <= 40) {
-            hasPassenger = false;
-            destination->setActive(false);
-            addScore(20);
-            addMoney(20);
-            cout << "Passenger dropped off! +20 score, +20 money." << endl;
-            fuel -= 1;
-            for (int i = 0; i < gameState.getActivePickupItems(); i++) {
-                PickupItem* p = gameState.getPickupItem(i);
-                if (p && !p->isActive()) {
-                    Position newPos = getRandomAdjacentBuildingPosition(nullptr, 0);
-                    p->setPosition(newPos.x, newPos.y);
-                    p->setActive(true);
+                case EVENT_DROPOFF:
+                    LOG_INFO("%s +20 score, +20 money.", taxi ? "Passenger dropped off!" : "Package delivered!");
                     break;
-                }
+                case EVENT_REFUEL: LOG_INFO("Refueled! +2 fuel, -1 money."); break;
+                case EVENT_REFUEL_FAILED: LOG_INFO("Not enough money to refuel!"); break;
+                default: break;
             }
-            return true;
         }
-        return false;
     }
-    void drawDestination() const override {
-        if (hasPassenger && destination->isActive()) {
-            destination->draw();
-        }
-    }
-    bool hasPassengerStatus() const { return hasPassenger; }
 };
 
-class DeliveryCar : public PlayerCar {
+// Floats the latest score change above the spot where it happened
+class HudEvents : public GameEventListener {
 private:
-    bool hasPackage;
-    Destination* destination;
-    GameState& gameState;
+    int delta;
+    int x, y;
+    int shownUntil;
 public:
-    DeliveryCar(int startX, int startY, float* startColor, float startFuel, float startMoney, GameState& gs)
-        : PlayerCar(startX, startY, startColor, startFuel, startMoney), hasPackage(false), destination(new Destination()), gameState(gs) {}
-    ~DeliveryCar() { delete destination; }
-    void pickUp() override {
-        if (fuel > 0 && !hasPackage) {
-            for (int i = 0; i < gameState.getActivePickupItems(); i++) {
-                PickupItem* p = gameState.getPickupItem(i);
-                if (p && p->isActive() && abs(x - p->getX()) <= 40 && abs(y - p->getY()) <= 40) {
-                    p->setActive(false);
-                    hasPackage = true;
-                    Position destPos = getRandomAdjacentBuildingPosition(nullptr, 0);
-                    destination->setPosition(destPos.x, destPos.y);
-                    cout << "Package picked up!" << endl;
-                    fuel -= 1;
-                    break;
-                }
-            }
+    HudEvents() : delta(0), x(0), y(0), shownUntil(0) {}
+    void onEvents(const GameEvent* events, int count) override {
+        int sum = 0;
+        for (int i = 0; i < count; i++) {
+            if (events[i].type == EVENT_GAME_OVER || events[i].value == 0) continue;
+            sum += events[i].value;
+            x = events[i].x;
+            y = events[i].y;
         }
-    }
-    bool dropOff() override {
-        if (fuel > 0 && hasPackage && destination->isActive() &&
-            abs(x - destination->getX()) <= 40 && abs(y - destination->getY()) <= 40) {
-            hasPackage = false;
-            destination->setActive(false);
-            addScore(20);
-            addMoney(20);
-            cout << "Package delivered! +20 score, +20 money." << endl;
-            fuel -= 1;
-            for (int i = 0; i < gameState.getActivePickupItems(); i++) {
-                PickupItem* p = gameState.getPickupItem(i);
-                if (p && !p->isActive()) {
-                    Position newPos = getRandomAdjacentBuildingPosition(nullptr, 0);
-                    p->setPosition(newPos.x, newPos.y);
-                    p->setActive(true);
-                    break;
-                }
-            }
-            return true;
+        if (sum != 0) {
+            delta = sum;
+            shownUntil = glutGet(GLUT_ELAPSED_TIME) + 1500;
         }
-        return false;
     }
-    void drawDestination() const override {
-        if (hasPackage && destination->isActive()) {
-            destination->draw();
-        }
+    void draw() const {
+        if (glutGet(GLUT_ELAPSED_TIME) >= shownUntil) return;
+        DrawString(x, y + 45, (delta > 0 ? "+" : "") + to_string(delta), delta > 0 ? colors[GREEN] : colors[RED]);
     }
-    bool hasPackageStatus() const { return hasPackage; }
 };
 
-class OtherCar : public Vehicle {
-private:
-    int direction;
-    static const int MOVE_SPEED = 2;
+AudioEvents audioEvents;
+LogEvents logEvents;
+HudEvents hudEvents;
+
+// The simulation runs on its own thread at config.tickMs and GameDisplay
+// draws at FPS, so a slow frame no longer delays a tick or the other way
+// round. Once the game starts that thread owns world, telemetry and the
+// replay; the main thread sees the world only through the snapshots it
+// publishes, and acts on it only through queued commands.
+enum GameCommand { COMMAND_REFUEL, COMMAND_PICK_UP_OR_DROP_OFF };
+
+// One tick's result, everything GameDisplay draws
+struct GameSnapshot {
+    WorldSnapshot world;
+    long long tick;             // the simulation tick this shows, 0 before the first
+    int remainingSeconds;
+    bool gameOver;
+    bool win;
+    GameSnapshot() : tick(0), remainingSeconds(0), gameOver(false), win(false) {}
+};
+
+TripleBuffer<GameSnapshot> snapshots;
+ConcurrentQueue<GameCommand> commands;
+vector<GameCommand> pendingCommands;        // simulation thread; global so it outlives the atexit join
+long long ticksRun = 0;                     // simulation thread
+ConcurrentQueue<GameEvent> tickEvents;      // for the listeners below, which play sound and draw
+GameEventListener* frameListeners[] = { &audioEvents, &logEvents, &hudEvents };
+atomic<bool> simRunning(false);
+thread simThread;
+chrono::steady_clock::time_point gameStart;
+
+// Hands each tick's events from the simulation thread to the main thread
+class ForwardEvents : public GameEventListener {
 public:
-    OtherCar(int startX = 42, int startY = 42, float* startColor = colors[GREEN])
-        : Vehicle(startX, startY, startColor), direction(rand() % 4) {}
-    void move() override {
-        int current_i = x / 40;
-        int current_j = y / 40;
-        int new_x = x, new_y = y;
-        switch (direction) {
-            case 0: new_y += MOVE_SPEED; break;
-            case 1: new_y -= MOVE_SPEED; break;
-            case 2: new_x -= MOVE_SPEED; break;
-            case 3: new_x += MOVE_SPEED; break;
-        }
-        if (new_x >= 0 && new_x <= 660 && new_y >= 0 && new_y <= 640) {
-            int new_i = new_x / 40;
-            int new_j = new_y / 40;
-            if (new_i >= 0 && new_i < 17 && new_j >= 0 && new_j < 17 && isRoadCell(new_i, new_j)) {
-                x = new_x;
-                y = new_y;
-                if (new_i != current_i || new_j != current_j) {
-                    if (new_i % 4 == 0 && new_j % 4 == 0) {
-                        int opposite = (direction + 2) % 4;
-                        int new_dir;
-                        do {
-                            new_dir = rand() % 4;
-                        } while (new_dir == opposite);
-                        direction = new_dir;
-                    }
-                }
-            } else {
-                direction = rand() % 4;
-            }
-        } else {
-            direction = rand() % 4;
-        }
-    }
-    void resetPosition(const Vehicle* player, const OtherCar* const* others, int numOthers) {
-        Position pos;
-        do {
-            pos = getRandomRoadPosition();
-            bool valid = true;
-            if (pos.x == player->x && pos.y == player->y) {
-                valid = false;
-            }
-            for (int i = 0; i < numOthers; i++) {
-                if (others[i] != this && pos.x == others[i]->x && pos.y == others[i]->y) {
-                    valid = false;
-                    break;
-                }
-            }
-            if (valid) {
-                x = pos.x;
-                y = pos.y;
-                direction = rand() % 4;
-                break;
-            }
-        } while (true);
-    }
-    void draw() const override {
-        DrawRoundRect(x, y, 20, 40, colors[VIOLET], 10);
-        DrawCircle(x + 2, y + 4, 3, colors[BLACK]);
-        DrawCircle(x + 2, y + 32, 3, colors[BLACK]);
-        DrawCircle(x + 18, y + 4, 3, colors[BLACK]);
-        DrawCircle(x + 18, y + 32, 3, colors[BLACK]);
-    }
+    void onEvents(const GameEvent* events, int count) override { tickEvents.push(events, count); }
 };
 
-// Global instances
-GameState gameState;
-HighScore highScores[10];
-int numHighScores = 0;
-string playerName;
-PlayerCar* player = nullptr;
-bool gameOver = false;
-OtherCar otherCar, otherCar2, otherCar3, otherCar4;
-Roads roads;
-int startTime;
-bool isWin = false;
+ForwardEvents forwardEvents;
+
+// Main thread: everything that happened since the last frame, as one batch
+void dispatchFrameEvents() {
+    static vector<GameEvent> batch;
+    tickEvents.drain(batch);
+    if (batch.empty()) return;
+    for (GameEventListener* listener : frameListeners) listener->onEvents(batch.data(), (int)batch.size());
+}
 
 // Function prototypes
 void GameDisplay();
 void NonPrintableKeys(int key, int x, int y);
+void NonPrintableKeysUp(int key, int x, int y);
 void PrintableKeys(unsigned char key, int x, int y);
-void Timer(int m);
+void RenderTimer(int m);
+void startGame();
 void MousePressedAndMoved(int x, int y);
 void MouseMoved(int x, int y);
 void MouseClicked(int button, int state, int x, int y);
-void sortHighScores(HighScore hs[], int n);
 
 // High score functions
+// The leaderboard loads in the background at launch; anything touching it waits here first
+future<void> highScoresLoaded;
+
+void waitForHighScores() {
+    if (highScoresLoaded.valid()) highScoresLoaded.get();
+}
+
+// Without a score service the game keeps its leaderboard in highscores.txt.
+// With one configured, that file belongs to the service and the game never
+// opens it: scores the service does not confirm go to highscores.local.txt,
+// which one instance at a time locks for as long as it runs. Any other
+// instance meanwhile uses a file named after its pid.
+string localHighScoresPath() {
+    if (config.scoreSocket.empty()) return "highscores.txt";
+    int lock = open("highscores.local.lock", O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock >= 0 && flock(lock, LOCK_EX | LOCK_NB) == 0) return "highscores.local.txt";
+    if (lock >= 0) close(lock);
+    return "highscores.local." + to_string(getpid()) + ".txt";
+}
+
 void loadHighScores() {
-    ifstream file("highscores.txt", ios::binary);
-    if (file.is_open()) {
-        numHighScores = 0;
-        while (numHighScores < 10 && file.read((char*)&highScores[numHighScores], sizeof(HighScore))) {
-            highScores[numHighScores].name[19] = '\0';
-            numHighScores++;
-        }
-        file.close();
-        sortHighScores(highScores, numHighScores);
-        cout << "Loaded " << numHighScores << " high scores from highscores.txt" << endl;
+    TraceScope trace("loadHighScores");
+    highScores.reset(new HighScoreStore(localHighScoresPath(), HIGHSCORE_CAPACITY));
+    if (highScores->load()) {
+        LOG_INFO("Loaded %d high scores from %s", highScores->count(), highScores->getPath().c_str());
     } else {
-        cout << "No highscores.txt found, starting with empty leaderboard" << endl;
-        numHighScores = 0;
+        LOG_INFO("No %s found, starting with empty leaderboard", highScores->getPath().c_str());
     }
 }
 
-void saveHighScores() {
-    ofstream file("highscores.txt", ios::binary | ios::trunc);
-    if (!file.is_open()) {
-        cerr << "Error: Could not open highscores.txt for writing" << endl;
+void saveHighScore(const string& name, int score) {
+    if (scoreServiceSubmit(config.scoreSocket, scoreSubmissionId(), name, score)) {
+        LOG_INFO("Submitted score %d for %s to %s", score, name.c_str(), config.scoreSocket.c_str());
         return;
     }
-    for (int i = 0; i < numHighScores; i++) {
-        file.write((char*)&highScores[i], sizeof(HighScore));
+    waitForHighScores();
+    if (highScores->add(name, score)) {
+        LOG_INFO("Saved high score %d for %s to %s, rank %d of %d", score, name.c_str(), highScores->getPath().c_str(),
+                 highScores->rankOf(score), highScores->count());
     }
-    file.close();
-    cout << "Saved " << numHighScores << " high scores to highscores.txt" << endl;
 }
 
-void displayLeaderboard() {
-    cout << "Leaderboard:\n";
-    if (numHighScores == 0) {
-        cout << "No high scores yet!" << endl;
-    } else {
-        for (int i = 0; i < numHighScores; i++) {
-            cout << i + 1 << ". " << highScores[i].name << " - " << highScores[i].score << endl;
-        }
+// Lets queued leaderboard writes reach the disk before the process exits
+void flushHighScores() {
+    waitForHighScores();
+    if (highScores) highScores->flush();
+}
+
+// One page of the shared leaderboard if the score service is up, else of the local file
+vector<HighScore> leaderboardPage(int offset, int n, int& total) {
+    vector<HighScore> page;
+    if (!scoreServicePage(config.scoreSocket, offset, n, page, total)) {
+        waitForHighScores();
+        page = highScores->page(offset, n);
+        total = highScores->count();
     }
+    return page;
 }
 
-void sortHighScores(HighScore hs[], int n) {
-    for (int i = 0; i < n - 1; i++) {
-        for (int j = 0; j < n - i - 1; j++) {
-            if (hs[j].score < hs[j + 1].score) {
-                HighScore temp = hs[j];
-                hs[j] = hs[j + 1];
-                hs[j + 1] = temp;
+// Menu screens, drawn in the game window while the world is generated in the background
+enum GameScreen { SCREEN_MENU, SCREEN_LEADERBOARD, SCREEN_ROLE, SCREEN_NAME, SCREEN_PLAYING };
+GameScreen screen = SCREEN_MENU;
+string chosenRole;      // "taxi", "delivery" or "" for random
+const int LEADERBOARD_PAGE = 10;
+int leaderboardOffset = 0;
+int leaderboardTotal = 0;
+vector<HighScore> leaderboardRows;
+
+void showLeaderboard(int offset) {
+    leaderboardOffset = offset;
+    leaderboardRows = leaderboardPage(offset, LEADERBOARD_PAGE, leaderboardTotal);
+    screen = SCREEN_LEADERBOARD;
+}
+
+void drawMenuScreen() {
+    DrawString(250, 600, "RUSH HOUR", colors[YELLOW]);
+    switch (screen) {
+        case SCREEN_MENU:
+            DrawString(220, 420, "1. View Leaderboard", colors[WHITE]);
+            DrawString(220, 390, "2. Start Game", colors[WHITE]);
+            DrawString(220, 360, "Esc. Quit", colors[WHITE]);
+            break;
+        case SCREEN_LEADERBOARD: {
+            DrawString(200, 540, "Leaderboard (" + to_string(leaderboardTotal) + " scores)", colors[WHITE]);
+            if (leaderboardRows.empty()) DrawString(200, 500, "No high scores yet!", colors[WHITE]);
+            for (size_t i = 0; i < leaderboardRows.size(); i++) {
+                DrawString(200, 500 - 30 * i, to_string(leaderboardOffset + i + 1) + ". " + leaderboardRows[i].name +
+                           " - " + to_string(leaderboardRows[i].score), colors[WHITE]);
             }
+            DrawString(120, 160, "N. Next page  P. Previous page  Esc. Back", colors[WHITE]);
+            break;
         }
+        case SCREEN_ROLE:
+            DrawString(220, 450, "Choose role:", colors[WHITE]);
+            DrawString(220, 420, "1. Taxi Driver", colors[WHITE]);
+            DrawString(220, 390, "2. Delivery Driver", colors[WHITE]);
+            DrawString(220, 360, "3. Random", colors[WHITE]);
+            break;
+        case SCREEN_NAME:
+            DrawString(220, 450, "Enter your name:", colors[WHITE]);
+            DrawString(220, 410, playerName + "_", colors[YELLOW]);
+            DrawString(220, 360, "Enter. Start", colors[WHITE]);
+            break;
+        default: break;
+    }
+}
+
+void MenuKeys(unsigned char key) {
+    switch (screen) {
+        case SCREEN_MENU:
+            if (key == '1') showLeaderboard(0);
+            else if (key == '2') screen = SCREEN_ROLE;
+            else if (key == 27) exit(0);
+            break;
+        case SCREEN_LEADERBOARD:
+            if ((key == 'n' || key == 'N') && leaderboardOffset + LEADERBOARD_PAGE < leaderboardTotal) {
+                showLeaderboard(leaderboardOffset + LEADERBOARD_PAGE);
+            } else if ((key == 'p' || key == 'P') && leaderboardOffset >= LEADERBOARD_PAGE) {
+                showLeaderboard(leaderboardOffset - LEADERBOARD_PAGE);
+            } else if (key == 27 || key == 'q' || key == 'Q') {
+                screen = SCREEN_MENU;
+            }
+            break;
+        case SCREEN_ROLE:
+            if (key >= '1' && key <= '3') {
+                chosenRole = key == '1' ? "taxi" : key == '2' ? "delivery" : "";
+                screen = SCREEN_NAME;
+            } else if (key == 27) {
+                screen = SCREEN_MENU;
+            }
+            break;
+        case SCREEN_NAME:
+            if (key == 13) {
+                if (playerName.empty()) playerName = "Anonymous";
+                startGame();
+            } else if (key == 8 || key == 127) {
+                if (!playerName.empty()) playerName.erase(playerName.size() - 1);
+            } else if (key == 27) {
+                screen = SCREEN_ROLE;
+            } else if (key >= 32 && key < 127 && playerName.length() < 19) {
+                playerName += (char)key;
+            }
+            break;
+        default: break;
     }
+    glutPostRedisplay();
 }
 
 void SetCanvasSize(int width, int height) {
@@ -497,205 +338,353 @@ void SetCanvasSize(int width, int height) {
     glLoadIdentity();
 }
 
-void drawCar() {
-    player->draw();
-    otherCar.draw();
-    otherCar2.draw();
-    otherCar3.draw();
-    otherCar4.draw();
-}
-
-void moveCar() {
-    otherCar.move();
-    otherCar2.move();
-    otherCar3.move();
-    otherCar4.move();
-}
-
 void GameDisplay() {
+    dispatchFrameEvents();
     glClearColor(0.2, 0.2, 0.2, 1);
     glClear(GL_COLOR_BUFFER_BIT);
-    if (gameOver) {
-        if (isWin) {
-            DrawString(200, 360, "You Win! Your score: " + to_string(player->getScore()), colors[GREEN]);
-        } else {
-            DrawString(200, 360, "Game Over! Your score: " + to_string(player->getScore()), colors[RED]);
-        }
-        DrawString(200, 340, "Press any key to exit.", colors[RED]);
+    long long shownTick = -1;
+    if (screen != SCREEN_PLAYING) {
+        drawMenuScreen();
     } else {
-        roads.drawRoads();
-        for (int i = 0; i < 3; i++) {
-            FuelStation* fs = gameState.getFuelStation(i);
-            if (fs) fs->draw();
-        }
-        for (int i = 0; i < gameState.getActivePickupItems(); i++) {
-            PickupItem* p = gameState.getPickupItem(i);
-            if (p) p->draw();
+        snapshots.update();
+        const GameSnapshot& snapshot = snapshots.read();
+        const WorldSnapshot& shown = snapshot.world;
+        shownTick = snapshot.tick;
+        if (snapshot.gameOver) {
+            if (snapshot.win) {
+                DrawString(200, 360, "You Win! Your score: " + to_string(shown.score), colors[GREEN]);
+            } else {
+                DrawString(200, 360, "Game Over! Your score: " + to_string(shown.score), colors[RED]);
+            }
+            DrawString(200, 340, "Press any key to exit.", colors[RED]);
+        } else {
+            shown.draw();
+            int minutes = snapshot.remainingSeconds / 60;
+            int seconds = snapshot.remainingSeconds % 60;
+            string timeStr = "Time=" + to_string(minutes) + ":" + (seconds < 10 ? "0" : "") + to_string(seconds);
+            DrawString(50, 700, "Score=" + to_string(shown.score), colors[RED]);
+            DrawString(510, 700, "Fuel=" + to_string(static_cast<int>(shown.fuel)), colors[BLUE]);
+            DrawString(290, 700, "Money=" + to_string(static_cast<int>(shown.money)), colors[GREEN]);
+            DrawString(170, 700, timeStr, colors[YELLOW]);
+            hudEvents.draw();
         }
-        player->drawDestination();
-        int currentTime = glutGet(GLUT_ELAPSED_TIME);
-        int elapsedTime = (currentTime - startTime) / 1000;
-        int remainingTime = 180 - elapsedTime;
-        if (remainingTime < 0) remainingTime = 0;
-        int minutes = remainingTime / 60;
-        int seconds = remainingTime % 60;
-        string timeStr = "Time=" + to_string(minutes) + ":" + (seconds < 10 ? "0" : "") + to_string(seconds);
-        DrawString(50, 700, "Score=" + to_string(player->getScore()), colors[RED]);
-        DrawString(510, 700, "Fuel=" + to_string(static_cast<int>(player->getFuel())), colors[BLUE]);
-        DrawString(290, 700, "Money=" + to_string(static_cast<int>(player->getMoney())), colors[GREEN]);
-        DrawString(170, 700, timeStr, colors[YELLOW]);
-        drawCar();
+    }
+    if (config.showOverlay) {
+        char line[64];
+        snprintf(line, sizeof(line), "Latency p50 %.0f ms  p99 %.0f ms",
+                 inputLatency.percentile(LatencyTracker::INPUT_TO_PRESENT, 50) / 1000.0,
+                 inputLatency.percentile(LatencyTracker::INPUT_TO_PRESENT, 99) / 1000.0);
+        DrawString(10, 5, line, colors[MAGENTA]);
     }
     glutSwapBuffers();
+    inputLatency.onPresent(shownTick);
+    static bool firstFrame = true;
+    if (firstFrame) {
+        firstFrame = false;
+        traceInstant("window shown");
+    }
+    if (screen == SCREEN_PLAYING && traceEnabled()) {
+        traceInstant("first game frame");
+        traceWrite(config.startupTrace);
+    }
+}
+
+// Arrow key state, kept by the main thread; the simulation tick reads only heldArrow
+enum Arrow { ARROW_LEFT, ARROW_RIGHT, ARROW_UP, ARROW_DOWN, ARROW_NONE };
+bool arrowHeld[4] = {false, false, false, false};
+Arrow lastArrow = ARROW_NONE;
+atomic<int> heldArrow(ARROW_NONE);
+
+Arrow arrowFromKey(int key) {
+    switch (key) {
+        case GLUT_KEY_LEFT: return ARROW_LEFT;
+        case GLUT_KEY_RIGHT: return ARROW_RIGHT;
+        case GLUT_KEY_UP: return ARROW_UP;
+        case GLUT_KEY_DOWN: return ARROW_DOWN;
+        default: return ARROW_NONE;
+    }
+}
+
+// The most recently pressed arrow wins; otherwise fall back to any still held
+Arrow currentArrow() {
+    if (lastArrow != ARROW_NONE && arrowHeld[lastArrow]) return lastArrow;
+    for (int i = 0; i < 4; i++) {
+        if (arrowHeld[i]) return (Arrow)i;
+    }
+    return ARROW_NONE;
 }
 
 void NonPrintableKeys(int key, int x, int y) {
-    if (gameOver) return;
-    int new_x = player->x, new_y = player->y;
-    if (key == GLUT_KEY_LEFT) { new_x -= 10; player->setFuel(player->getFuel() - 0.25); }
-    else if (key == GLUT_KEY_RIGHT) { new_x += 10; player->setFuel(player->getFuel() - 0.25); }
-    else if (key == GLUT_KEY_UP) { new_y += 10; player->setFuel(player->getFuel() - 0.25); }
-    else if (key == GLUT_KEY_DOWN) { new_y -= 10; player->setFuel(player->getFuel() - 0.25); }
-    if (new_x >= 0 && new_x <= 660 && new_y >= 0 && new_y <= 640) {
-        int cell_i = new_x / 40;
-        int cell_j = new_y / 40;
-        if (cell_i >= 0 && cell_i < 17 && cell_j >= 0 && cell_j < 17) {
-            if (isRoadCell(cell_i, cell_j)) {
-                player->x = new_x;
-                player->y = new_y;
-                bool hasCollision = false;
-                OtherCar* others[] = {&otherCar, &otherCar2, &otherCar3, &otherCar4};
-                if (collides(*player, otherCar)) {
-                    otherCar.resetPosition(player, others, 4);
-                    hasCollision = true;
-                    player->addScore(-5);
-                }
-                if (collides(*player, otherCar2)) {
-                    otherCar2.resetPosition(player, others, 4);
-                    hasCollision = true;
-                    player->addScore(-5);
-                }
-                if (collides(*player, otherCar3)) {
-                    otherCar3.resetPosition(player, others, 4);
-                    hasCollision = true;
-                    player->addScore(-5);
-                }
-                if (collides(*player, otherCar4)) {
-                    otherCar4.resetPosition(player, others, 4);
-                    hasCollision = true;
-                    player->addScore(-5);
-                }
-                if (hasCollision) {
-                    Mix_PlayChannel(-1, gCollisionSound, 0);
-                }
-            } else {
-                Mix_PlayChannel(-1, gCollisionSound, 0);
-                player->addScore(-4);
-            }
-        } else {
-            Mix_PlayChannel(-1, gCollisionSound, 0);
-            player->addScore(-4);
-        }
+    Arrow arrow = arrowFromKey(key);
+    if (arrow == ARROW_NONE || screen != SCREEN_PLAYING) return;
+    arrowHeld[arrow] = true;
+    lastArrow = arrow;
+    heldArrow = currentArrow();
+    inputLatency.onInput();
+}
+
+void NonPrintableKeysUp(int key, int x, int y) {
+    Arrow arrow = arrowFromKey(key);
+    if (arrow == ARROW_NONE || screen != SCREEN_PLAYING) return;
+    arrowHeld[arrow] = false;
+    heldArrow = currentArrow();
+    inputLatency.onInput();
+}
+
+// Moves the player one tick in the held direction
+void movePlayer() {
+    switch ((Arrow)heldArrow.load()) {
+        case ARROW_LEFT: world.movePlayer(-1, 0, config.playerSpeed); break;
+        case ARROW_RIGHT: world.movePlayer(1, 0, config.playerSpeed); break;
+        case ARROW_UP: world.movePlayer(0, 1, config.playerSpeed); break;
+        case ARROW_DOWN: world.movePlayer(0, -1, config.playerSpeed); break;
+        default: break;
     }
-    glutPostRedisplay();
 }
 
 void PrintableKeys(unsigned char key, int x, int y) {
-    if (gameOver) { exit(0); }
+    if (screen != SCREEN_PLAYING) {
+        MenuKeys(key);
+        return;
+    }
+    if (snapshots.read().gameOver) { exit(0); }
     if (key == 27) { exit(1); }
-    if (key == 'b' || key == 'B') { cout << "b pressed" << endl; }
-    if (key == ' ') {
-        for (int i = 0; i < 3; i++) {
-            FuelStation* fs = gameState.getFuelStation(i);
-            if (fs && abs(player->x - fs->getX()) <= 40 && abs(player->y - fs->getY()) <= 40) {
-                if (player->refuel()) {
-                    Mix_PlayChannel(-1, gRefuellingSound, 0);
-                }
-                break;
-            }
+    if (key == 'b' || key == 'B') { LOG_DEBUG("b pressed"); }
+    if (key == 'o' || key == 'O') { config.showOverlay = !config.showOverlay; }
+    if (key == ' ' || key == 13) { inputLatency.onInput(); }
+    if (key == ' ') commands.push(COMMAND_REFUEL);
+    if (key == 13) commands.push(COMMAND_PICK_UP_OR_DROP_OFF);
+}
+
+// Snapshot of the world for the replay file
+void recordReplayFrame() {
+    if (!replay.isOpen()) return;
+    ReplayFrame frame;
+    world.capture(frame);
+    replay.record(frame);
+}
+
+void publishSnapshot(int elapsedMs, bool over, bool win) {
+    GameSnapshot& snapshot = snapshots.writeSlot();
+    world.snapshot(snapshot.world);
+    snapshot.tick = ticksRun;
+    snapshot.remainingSeconds = max(0, 180 - elapsedMs / 1000);
+    snapshot.gameOver = over;
+    snapshot.win = win;
+    snapshots.publish();
+}
+
+// One simulation tick; false once the game is over
+bool simulationTick() {
+    inputLatency.onTick(++ticksRun);
+    commands.drain(pendingCommands);
+    for (GameCommand command : pendingCommands) {
+        if (command == COMMAND_REFUEL) world.refuel();
+        else world.pickUpOrDropOff();
+    }
+    movePlayer();
+    world.moveTraffic();
+    world.resolveCollisions();
+    const PlayerCar* player = world.player;
+    telemetry.sample(player->x, player->y, player->getFuel(), player->getScore());
+    recordReplayFrame();
+    int elapsedMs = (int)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - gameStart).count();
+    bool over = elapsedMs >= 3 * 60 * 1000 || player->getFuel() <= 0 || player->getScore() < 0 || player->getScore() >= 100;
+    bool win = over && player->getScore() >= 100;
+    if (over) gameEvents.push(EVENT_GAME_OVER, player->x, player->y, win ? 1 : 0);
+    gameEvents.dispatch();
+    publishSnapshot(elapsedMs, over, win);
+    if (over) {
+        waitForHighScores();
+        if (player->getScore() > 0 || highScores->count() == 0) {
+            LOG_INFO("Attempting to save score: %d for %s", player->getScore(), playerName.c_str());
+            saveHighScore(playerName, player->getScore());
         }
     }
-    if (key == 13) {
-        if (dynamic_cast<Taxi*>(player) && !dynamic_cast<Taxi*>(player)->hasPassengerStatus()) {
-            player->pickUp();
-        } else if (dynamic_cast<DeliveryCar*>(player) && !dynamic_cast<DeliveryCar*>(player)->hasPackageStatus()) {
-            player->pickUp();
-        } else {
-            if (player->dropOff()) {
-                Mix_PlayChannel(-1, gDestinationSound, 0);
-            }
-        }
+    return !over;
+}
+
+// Ticks at a fixed rate until the game ends or stopSimulation is called
+void simulationLoop() {
+    chrono::milliseconds tick(config.tickMs);
+    chrono::steady_clock::time_point next = gameStart + tick;
+    while (simRunning) {
+        this_thread::sleep_until(next);
+        if (!simRunning || !simulationTick()) break;
+        next += tick;
+        // after a stall (a debugger, a suspended laptop) carry on from now rather than catch up in a burst
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        if (now - next > 4 * tick) next = now;
     }
+}
+
+// Registered with atexit so the thread is joined before the files it writes are closed
+void stopSimulation() {
+    simRunning = false;
+    if (simThread.joinable()) simThread.join();
+}
+
+// Redraws at FPS whatever the tick rate; stops once the game-over screen has been drawn
+void RenderTimer(int m) {
+    if (snapshots.read().gameOver) return;
     glutPostRedisplay();
+    glutTimerFunc(1000 / FPS, RenderTimer, 0);
 }
 
-void Timer(int m) {
-    if (!gameOver) {
-        moveCar();
-        bool hasCollision = false;
-        OtherCar* others[] = {&otherCar, &otherCar2, &otherCar3, &otherCar4};
-        if (collides(*player, otherCar)) {
-            otherCar.resetPosition(player, others, 4);
-            hasCollision = true;
-            player->addScore(-5);
-        }
-        if (collides(*player, otherCar2)) {
-            otherCar2.resetPosition(player, others, 4);
-            hasCollision = true;
-            player->addScore(-5);
-        }
-        if (collides(*player, otherCar3)) {
-            otherCar3.resetPosition(player, others, 4);
-            hasCollision = true;
-            player->addScore(-5);
-        }
-        if (collides(*player, otherCar4)) {
-            otherCar4.resetPosition(player, others, 4);
-            hasCollision = true;
-            player->addScore(-5);
-        }
-        if (hasCollision) {
-            Mix_PlayChannel(-1, gCollisionSound, 0);
-        }
-        int currentTime = glutGet(GLUT_ELAPSED_TIME);
-        if (currentTime - startTime >= 3 * 60 * 1000 || player->getFuel() <= 0 || player->getScore() < 0 || player->getScore() >= 100) {
-            gameOver = true;
-            if (player->getScore() >= 100) {
-                isWin = true;
-            }
-            if (player->getScore() > 0 || numHighScores == 0) {
-                cout << "Attempting to save score: " << player->getScore() << " for " << playerName << endl;
-                if (numHighScores < 10) {
-                    strncpy(highScores[numHighScores].name, playerName.c_str(), 19);
-                    highScores[numHighScores].name[19] = '\0';
-                    highScores[numHighScores].score = player->getScore();
-                    numHighScores++;
-                    cout << "Added new high score at index " << numHighScores - 1 << endl;
-                } else {
-                    int minIndex = 0;
-                    for (int i = 1; i < numHighScores; i++) {
-                        if (highScores[i].score < highScores[minIndex].score) {
-                            minIndex = i;
-                        }
-                    }
-                    if (player->getScore() > highScores[minIndex].score) {
-                        strncpy(highScores[minIndex].name, playerName.c_str(), 19);
-                        highScores[minIndex].name[19] = '\0';
-                        highScores[minIndex].score = player->getScore();
-                        cout << "Replaced high score at index " << minIndex << endl;
-                    }
-                }
-                sortHighScores(highScores, numHighScores);
-                saveHighScores();
-            }
-        } else {
-            glutTimerFunc(100, Timer, 0);
+// Starts this session's telemetry and replay files, e.g.
+// telemetry/session-20240101-120000-1234.rhtl and .rhrp
+void startRecording(const string& role) {
+    if (config.telemetryDir.empty()) return;
+    mkdir(config.telemetryDir.c_str(), 0755);
+    char stamp[32];
+    time_t now = time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    string base = config.telemetryDir + "/session-" + stamp + "-" + to_string(getpid());
+    if (telemetry.open(base + ".rhtl", playerName, role, config.tickMs)) gameEvents.subscribe(&telemetry);
+    if (replay.open(base + ".rhrp", role == "taxi" ? REPLAY_TAXI : REPLAY_DELIVERY, config.tickMs)) {
+        recordReplayFrame();
+    }
+}
+
+// Ends telemetry of a session quit before game over, and writes the replay index
+void closeRecordings() {
+    telemetry.close();
+    replay.close();
+}
+
+// Starting positions; generated in the background while the menu is up
+future<WorldLayout> worldReady;
+future<Mix_Music*> gameMusicLoad;
+
+WorldLayout tracedGenerateWorld() {
+    TraceScope trace("world generation");
+    return generateWorld();
+}
+
+// Leaves the menu: places everything and starts the simulation
+void startGame() {
+    traceInstant("game started");
+    long long t = traceNow();
+    WorldLayout layout = worldReady.get();
+    traceSpan("wait for world", t);
+    string role = !chosenRole.empty() ? chosenRole : (rand() % 2 == 0 ? "taxi" : "delivery");
+    world.populate(layout, role == "taxi");
+    // the game's few cars never fill a job; only a bigger city is worth the threads
+    if ((int)world.traffic.size() > World::CARS_PER_JOB) {
+        jobs.reset(new JobSystem());
+        world.jobs = jobs.get();
+    }
+    taxiRole = role == "taxi";
+    gameEvents.subscribe(&forwardEvents);
+    startRecording(role);
+    t = traceNow();
+    gGameMusic = gameMusicLoad.get();
+    traceSpan("wait for game music", t);
+    screen = SCREEN_PLAYING;
+    gameStart = chrono::steady_clock::now();
+    publishSnapshot(0, false, false);
+    simRunning = true;
+    simThread = thread(simulationLoop);
+    glutTimerFunc(1000 / FPS, RenderTimer, 0);
+    Mix_HaltMusic();
+    Mix_PlayMusic(gGameMusic, -1);
+}
+
+// Replay viewer: plays a recorded session without simulating it
+ReplayReader replayReader;
+unsigned int replayTick = 0;
+bool replayPaused = false;
+
+void ReplayDisplay() {
+    ReplayFrame frame;
+    glClearColor(0.2, 0.2, 0.2, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+    if (replayReader.seek(replayTick, frame)) {
+        bool taxi = replayReader.getRole() == REPLAY_TAXI;
+        world.roads.drawRoads();
+        for (int i = 0; i < REPLAY_STATIONS; i++) FuelStation(frame.stationX[i], frame.stationY[i]).draw();
+        for (int i = 0; i < frame.numItems; i++) {
+            if (!frame.itemActive[i]) continue;
+            if (taxi) Passenger(frame.itemX[i], frame.itemY[i]).draw();
+            else Box(frame.itemX[i], frame.itemY[i]).draw();
         }
+        if (frame.carrying && frame.destActive) DrawSquare(frame.destX, frame.destY, 40, colors[GREEN]);
+        drawCarBody(frame.carX[0], frame.carY[0], taxi ? colors[YELLOW] : colors[RED]);
+        for (int i = 1; i < frame.numCars; i++) drawCarBody(frame.carX[i], frame.carY[i], colors[VIOLET]);
+        int seconds = replayTick * replayReader.getTickMs() / 1000;
+        int total = replayReader.tickCount() * replayReader.getTickMs() / 1000;
+        char clock[64];
+        snprintf(clock, sizeof(clock), "Replay %d:%02d / %d:%02d%s", seconds / 60, seconds % 60, total / 60, total % 60,
+                 replayPaused ? " (paused)" : "");
+        DrawString(50, 700, "Score=" + to_string(frame.score), colors[RED]);
+        DrawString(290, 700, "Money=" + to_string(frame.money), colors[GREEN]);
+        DrawString(510, 700, "Fuel=" + to_string(frame.fuelMilli / 1000), colors[BLUE]);
+        DrawString(10, 5, clock, colors[YELLOW]);
+        DrawString(300, 5, "Space pause  Left/Right 10 s  Home restart", colors[WHITE]);
+    }
+    glutSwapBuffers();
+}
+
+void ReplayTimer(int m) {
+    if (!replayPaused && replayTick + 1 < replayReader.tickCount()) {
+        replayTick++;
+        glutPostRedisplay();
     }
+    glutTimerFunc(replayReader.getTickMs(), ReplayTimer, 0);
+}
+
+void ReplaySpecialKeys(int key, int x, int y) {
+    int step = 10000 / replayReader.getTickMs();
+    if (key == GLUT_KEY_LEFT) replayTick = replayTick > (unsigned int)step ? replayTick - step : 0;
+    else if (key == GLUT_KEY_RIGHT) replayTick = min(replayTick + step, replayReader.tickCount() - 1);
+    else if (key == GLUT_KEY_HOME) replayTick = 0;
+    glutPostRedisplay();
+}
+
+void ReplayKeys(unsigned char key, int x, int y) {
+    if (key == 27) exit(0);
+    if (key == ' ') replayPaused = !replayPaused;
+    glutPostRedisplay();
+}
+
+int runReplay(int argc, char* argv[]) {
+    if (!replayReader.open(config.replayFile) || replayReader.tickCount() == 0) {
+        LOG_ERROR("Could not read replay %s", config.replayFile.c_str());
+        return 1;
+    }
+    LOG_INFO("Replaying %u ticks from %s", replayReader.tickCount(), config.replayFile.c_str());
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
+    glutInitWindowPosition(50, 50);
+    glutInitWindowSize(680, 720);
+    glutCreateWindow("OOP Project - Replay");
+    SetCanvasSize(680, 720);
+    glutDisplayFunc(ReplayDisplay);
+    glutSpecialFunc(ReplaySpecialKeys);
+    glutKeyboardFunc(ReplayKeys);
+    glutTimerFunc(replayReader.getTickMs(), ReplayTimer, 0);
+    glutMainLoop();
+    return 0;
+}
+
+void reportAudio() {
+    LOG_INFO("Audio path: %s", audioMeter.summary().c_str());
+}
+
+void reportVoices() {
+    LOG_INFO("Sound effects: %s", voices.summary().c_str());
+}
+
+void reportDroppedEvents() {
+    if (gameEvents.droppedCount() > 0) LOG_WARN("%d game events dropped: more than %d in one tick", gameEvents.droppedCount(), EventQueue::CAPACITY);
+}
+
+void reportLatency() {
+    if (inputLatency.count() > 0) LOG_INFO("Input latency: %s", inputLatency.summary().c_str());
 }
 
 void MousePressedAndMoved(int x, int y) {
-    cout << x << " " << y << endl;
+    LOG_DEBUG("%d %d", x, y);
     glutPostRedisplay();
 }
 
@@ -703,84 +692,77 @@ void MouseMoved(int x, int y) { glutPostRedisplay(); }
 
 void MouseClicked(int button, int state, int x, int y) {
     if (button == GLUT_LEFT_BUTTON) {
-        if (state == GLUT_DOWN) cout << "Left Button Down" << endl;
-        else if (state == GLUT_UP) cout << "Left Button Up" << endl;
+        if (state == GLUT_DOWN) LOG_DEBUG("Left Button Down");
+        else if (state == GLUT_UP) LOG_DEBUG("Left Button Up");
     }
     else if (button == GLUT_RIGHT_BUTTON) {
-        cout << "Right Button Pressed" << endl;
+        LOG_DEBUG("Right Button Pressed");
     }
     glutPostRedisplay();
 }
 
 int main(int argc, char* argv[]) {
+    logStart();
+    atexit(logShutdown);
+    parseConfig(argc, argv);
+    atexit(reportDroppedEvents);
+    atexit(reportLatency);
+    atexit(flushHighScores);
+    atexit(closeRecordings);
+    atexit(stopSimulation);
+    if (!config.replayFile.empty()) return runReplay(argc, argv);
+    if (!config.startupTrace.empty()) traceStart();
+    // Nothing before the game needs the leaderboard unless it is asked for
+    highScoresLoaded = async(launch::async, loadHighScores);
+    long long t = traceNow();
     if (SDL_Init(SDL_INIT_AUDIO) < 0) {
-        cerr << "SDL could not initialize! SDL_Error: " << SDL_GetError() << endl;
+        LOG_ERROR("SDL could not initialize! SDL_Error: %s", SDL_GetError());
         return 1;
     }
+    traceSpan("SDL_Init", t);
+    t = traceNow();
     if (!(Mix_Init(MIX_INIT_MP3) & MIX_INIT_MP3)) {
-        cerr << "SDL_mixer could not initialize! SDL_mixer Error: " << Mix_GetError() << endl;
+        LOG_ERROR("SDL_mixer could not initialize! SDL_mixer Error: %s", Mix_GetError());
         SDL_Quit();
         return 1;
     }
-    if (Mix_OpenAudio(44100, MIX_DEFAULT_FORMAT, 2, 2048) < 0) {
-        cerr << "SDL_mixer could not open audio device! SDL_mixer Error: " << Mix_GetError() << endl;
+    traceSpan("Mix_Init", t);
+    t = traceNow();
+    if (Mix_OpenAudio(config.audioRate, MIX_DEFAULT_FORMAT, config.audioChannels, config.audioBuffer) < 0) {
+        LOG_ERROR("SDL_mixer could not open audio device! SDL_mixer Error: %s", Mix_GetError());
         Mix_Quit();
         SDL_Quit();
         return 1;
     }
-    gMenuMusic = Mix_LoadMUS("menu.mp3");
-    if (gMenuMusic == NULL) {
-        cerr << "Failed to load menu music! SDL_mixer Error: " << Mix_GetError() << endl;
-    }
-    gGameMusic = Mix_LoadMUS("gametime.mp3");
-    if (gGameMusic == NULL) {
-        cerr << "Failed to load game music! SDL_mixer Error: " << Mix_GetError() << endl;
-    }
-    gCollisionSound = Mix_LoadWAV("collision.mp3");
-    if (gCollisionSound == NULL) {
-        cerr << "Failed to load collision sound! SDL_mixer Error: " << Mix_GetError() << endl;
-    }
-    gDestinationSound = Mix_LoadWAV("destination.mp3");
-    if (gDestinationSound == NULL) {
-        cerr << "Failed to load destination sound! SDL_mixer Error: " << Mix_GetError() << endl;
-    }
-    gRefuellingSound = Mix_LoadWAV("refueling.mp3");
-    if (gRefuellingSound == NULL) {
-        cerr << "Failed to load refuelling sound! SDL_mixer Error: " << Mix_GetError() << endl;
-    }
+    traceSpan("Mix_OpenAudio", t);
+    int openedRate = 0, openedChannels = 0;
+    Uint16 openedFormat = 0;
+    Mix_QuerySpec(&openedRate, &openedFormat, &openedChannels);
+    LOG_INFO("Audio: %d Hz, %d channels, %d-frame buffer (%.1f ms)", openedRate, openedChannels, config.audioBuffer,
+             1000.0 * config.audioBuffer / (openedRate > 0 ? openedRate : config.audioRate));
+    if (config.audioMeasure) {
+        audioMeter.start(config.audioBuffer);
+        atexit(reportAudio);
+    }
+    // A delivery must always be heard; crashes are frequent and may be dropped
+    voices.setPolicy(SOUND_DROPOFF, EffectPolicy{ 3, 100, 1 });
+    voices.setPolicy(SOUND_REFUEL, EffectPolicy{ 2, 150, 1 });
+    voices.setPolicy(SOUND_COLLISION, EffectPolicy{ 1, 120, 2 });
+    atexit(reportVoices);
+    // Decode everything in the background; effects are played once they are ready
+    setPcmCacheDir(config.pcmCacheDir);
+    future<Mix_Music*> menuMusic = loadMusicAsync("menu.mp3");
+    gameMusicLoad = loadMusicAsync("gametime.mp3");
+    gCollisionSound.load("collision.mp3");
+    gDestinationSound.load("destination.mp3");
+    gRefuellingSound.load("refueling.mp3");
+    t = traceNow();
+    gMenuMusic = menuMusic.get();
+    traceSpan("wait for menu music", t);
     Mix_PlayMusic(gMenuMusic, -1);
     InitRandomizer();
-    loadHighScores();
-    bool startGame = false;
-    while (!startGame) {
-        cout << "1. View Leaderboard\n2. Start Game\n";
-        int choice;
-        cin >> choice;
-        if (choice == 1) {
-            displayLeaderboard();
-        } else if (choice == 2) {
-            startGame = true;
-        } else {
-            cout << "Invalid choice.\n";
-        }
-    }
-    cout << "Choose role: 1. Taxi Driver, 2. Delivery Driver, 3. Random\n";
-    int roleChoice;
-    cin >> roleChoice;
-    string role;
-    if (roleChoice == 1) {
-        role = "taxi";
-    } else if (roleChoice == 2) {
-        role = "delivery";
-    } else {
-        role = (rand() % 2 == 0 ? "taxi" : "delivery");
-    }
-    cout << "Enter your name: ";
-    cin >> ws;
-    getline(cin, playerName);
-    if (playerName.empty()) playerName = "Anonymous";
-    if (playerName.length() > 19) playerName = playerName.substr(0, 19);
-    float* carColor = (role == "taxi" ? colors[YELLOW] : colors[RED]);
+    worldReady = async(launch::async, tracedGenerateWorld);
+    t = traceNow();
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
     glutInitWindowPosition(50, 50);
@@ -788,82 +770,11 @@ int main(int argc, char* argv[]) {
     glutInitWindowSize(width, height);
     glutCreateWindow("OOP Project");
     SetCanvasSize(width, height);
-    if (role == "taxi") {
-        player = new Taxi(0, 640, carColor, 100.0, 0.0, gameState);
-    } else {
-        player = new DeliveryCar(0, 640, carColor, 100.0, 0.0, gameState);
-    }
-    Position pos;
-    Position occupied[20];
-    int occupiedCount = 0;
-    do {
-        pos = getRandomRoadPosition();
-    } while (pos.x == player->x && pos.y == player->y);
-    otherCar = OtherCar(pos.x, pos.y);
-    do {
-        pos = getRandomRoadPosition();
-    } while ((pos.x == player->x && pos.y == player->y) || 
-             (pos.x == otherCar.x && pos.y == otherCar.y));
-    otherCar2 = OtherCar(pos.x, pos.y);
-    do {
-        pos = getRandomRoadPosition();
-    } while ((pos.x == player->x && pos.y == player->y) || 
-             (pos.x == otherCar.x && pos.y == otherCar.y) || 
-             (pos.x == otherCar2.x && pos.y == otherCar2.y));
-    otherCar3 = OtherCar(pos.x, pos.y);
-    do {
-        pos = getRandomRoadPosition();
-    } while ((pos.x == player->x && pos.y == player->y) || 
-             (pos.x == otherCar.x && pos.y == otherCar.y) || 
-             (pos.x == otherCar2.x && pos.y == otherCar2.y) || 
-             (pos.x == otherCar3.x && pos.y == otherCar3.y));
-    otherCar4 = OtherCar(pos.x, pos.y);
-    for (int i = 0; i < 3; i++) {
-        do {
-            pos = getRandomAdjacentBuildingPosition(occupied, occupiedCount);
-            bool valid = true;
-            for (int j = 0; j < occupiedCount; j++) {
-                if (pos.x == occupied[j].x && pos.y == occupied[j].y) {
-                    valid = false;
-                    break;
-                }
-            }
-            if (valid) {
-                gameState.setFuelStation(i, new FuelStation(pos.x, pos.y));
-                occupied[occupiedCount++] = pos;
-                break;
-            }
-        } while (true);
-    }
-    int activePickupItems = 2 + rand() % 3;
-    gameState.setActivePickupItems(activePickupItems);
-    for (int i = 0; i < activePickupItems; i++) {
-        do {
-            pos = getRandomAdjacentBuildingPosition(occupied, occupiedCount);
-            bool valid = true;
-            for (int j = 0; j < occupiedCount; j++) {
-                if (pos.x == occupied[j].x && pos.y == occupied[j].y) {
-                    valid = false;
-                    break;
-                }
-            }
-            if (valid) {
-                if (role == "taxi") {
-                    gameState.setPickupItem(i, new Passenger(pos.x, pos.y));
-                } else {
-                    gameState.setPickupItem(i, new Box(pos.x, pos.y));
-                }
-                occupied[occupiedCount++] = pos;
-                break;
-            }
-        } while (true);
-    }
-    startTime = glutGet(GLUT_ELAPSED_TIME);
-    glutTimerFunc(100, Timer, 0);
-    Mix_HaltMusic();
-    Mix_PlayMusic(gGameMusic, -1);
+    traceSpan("glutInit and window", t);
     glutDisplayFunc(GameDisplay);
+    glutIgnoreKeyRepeat(1);
     glutSpecialFunc(NonPrintableKeys);
+    glutSpecialUpFunc(NonPrintableKeysUp);
     glutKeyboardFunc(PrintableKeys);
     glutMouseFunc(MouseClicked);
     glutPassiveMotionFunc(MouseMoved);
@@ -872,12 +783,11 @@ int main(int argc, char* argv[]) {
     Mix_HaltMusic();
     Mix_FreeMusic(gMenuMusic);
     Mix_FreeMusic(gGameMusic);
-    Mix_FreeChunk(gCollisionSound);
-    Mix_FreeChunk(gDestinationSound);
-    Mix_FreeChunk(gRefuellingSound);
+    Mix_FreeChunk(gCollisionSound.wait());
+    Mix_FreeChunk(gDestinationSound.wait());
+    Mix_FreeChunk(gRefuellingSound.wait());
     Mix_CloseAudio();
     Mix_Quit();
     SDL_Quit();
-    delete player;
     return 0;
 }
\ No newline at end of file
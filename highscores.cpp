@@ -0,0 +1,432 @@
+/*
+ * highscores.cpp
+ *
+ */
+#include "highscores.h"
+#include "log.h"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct Crc32Table {
+    unsigned int entries[256];
+};
+
+unsigned int crc32(const unsigned char* data, size_t len) {
+    // Built on first use; a function-local static is initialised once even
+    // when the writer thread and the caller both get here first
+    static const Crc32Table table = []() {
+        Crc32Table t;
+        for (unsigned int i = 0; i < 256; i++) {
+            unsigned int c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t.entries[i] = c;
+        }
+        return t;
+    }();
+    unsigned int crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static void putLE16(unsigned char* p, unsigned int v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static void putLE32(unsigned char* p, unsigned int v) {
+    for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static unsigned int getLE16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int getLE32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static void encodeHeader(unsigned char* out) {
+    memcpy(out, "RHHS", 4);
+    putLE16(out + 4, HIGHSCORE_VERSION);
+    putLE16(out + 6, HIGHSCORE_RECORD_SIZE);
+    putLE32(out + 8, 0);
+    putLE32(out + 12, crc32(out, 12));
+}
+
+// The name of a record, which is NUL-terminated unless it is 19 characters long
+static string recordName(const unsigned char* r) {
+    return string((const char*)r, strnlen((const char*)r, 19));
+}
+
+static bool writeAll(int fd, const unsigned char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n <= 0) return false;
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Remap once this many bytes of appended records are held in memory
+static const size_t TAIL_REMAP_BYTES = 1 << 20;
+
+HighScoreStore::HighScoreStore(const string& file, int maxEntries, bool openReadOnly)
+    : path(file), capacity(maxEntries), readOnly(openReadOnly), nextSequence(0),
+      mapped(nullptr), mappedSize(0), mappedRecords(0),
+      appendFd(-1), writerStarted(false), stopping(false), writing(false),
+      queuedTicket(0), writtenTicket(0) {}
+
+HighScoreStore::~HighScoreStore() {
+    if (writerStarted) {
+        {
+            lock_guard<mutex> lock(writeMutex);
+            stopping = true;
+        }
+        writeReady.notify_one();
+        writer.join();
+    }
+    unmap();
+    if (appendFd >= 0) close(appendFd);
+}
+
+void HighScoreStore::unmap() {
+    if (mapped) munmap((void*)mapped, mappedSize);
+    mapped = nullptr;
+    mappedSize = 0;
+    mappedRecords = 0;
+}
+
+// Maps the whole file read-only. Records appended so far become part of the mapping.
+bool HighScoreStore::map() {
+    unmap();
+    tail.clear();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p != MAP_FAILED) {
+            mapped = (const unsigned char*)p;
+            mappedSize = st.st_size;
+            if (mappedSize >= (size_t)HIGHSCORE_HEADER_SIZE) {
+                mappedRecords = (mappedSize - HIGHSCORE_HEADER_SIZE) / HIGHSCORE_RECORD_SIZE;
+            }
+        } else {
+            LOG_ERROR("Could not map %s", path.c_str());
+        }
+    }
+    close(fd);
+    return true;
+}
+
+const unsigned char* HighScoreStore::record(unsigned int id) const {
+    if (id < mappedRecords) return mapped + HIGHSCORE_HEADER_SIZE + (size_t)id * HIGHSCORE_RECORD_SIZE;
+    return &tail[(size_t)(id - mappedRecords) * HIGHSCORE_RECORD_SIZE];
+}
+
+void HighScoreStore::clearIndex() {
+    index.clear();
+    bestByPlayer.clear();
+}
+
+// Adds a record to the index. Returns false if its checksum does not match.
+bool HighScoreStore::indexRecord(unsigned int id) {
+    const unsigned char* r = record(id);
+    if (getLE32(r + 28) != crc32(r, 28)) return false;
+    IndexKey key = { (int)getLE32(r + 20), getLE32(r + 24), id };
+    if (key.sequence >= nextSequence) nextSequence = key.sequence + 1;
+    if (capacity > 0 && (int)index.size() >= capacity && !Better()(key, *index.rbegin())) return true;
+    index.insert(key);
+    IndexKey& best = bestByPlayer.emplace(recordName(r), key).first->second;
+    if (Better()(key, best)) best = key;
+    if (capacity > 0 && (int)index.size() > capacity) {
+        IndexKey worst = *index.rbegin();
+        index.erase(prev(index.end()));
+        // dropping a player's best means none of their entries are left
+        auto w = bestByPlayer.find(recordName(record(worst.record)));
+        if (w != bestByPlayer.end() && w->second.sequence == worst.sequence) bestByPlayer.erase(w);
+    }
+    return true;
+}
+
+bool HighScoreStore::load() {
+    flush();
+    if (!map()) return false;
+    clearIndex();
+    nextSequence = 0;
+    if (mappedSize > 0 && (mappedSize < 4 || memcmp(mapped, "RHHS", 4) != 0)) {
+        // Legacy file: raw HighScore structs as written by older builds
+        size_t n = mappedSize / sizeof(HighScore);
+        vector<unsigned char> data(HIGHSCORE_HEADER_SIZE + n * HIGHSCORE_RECORD_SIZE);
+        encodeHeader(data.data());
+        for (size_t i = 0; i < n; i++) {
+            HighScore hs;
+            memcpy(&hs, mapped + i * sizeof(HighScore), sizeof(HighScore));
+            hs.name[19] = '\0';
+            unsigned char* r = &data[HIGHSCORE_HEADER_SIZE + i * HIGHSCORE_RECORD_SIZE];
+            strncpy((char*)r, hs.name, 20);
+            putLE32(r + 20, (unsigned int)hs.score);
+            putLE32(r + 24, (unsigned int)i);
+            putLE32(r + 28, crc32(r, 28));
+        }
+        rebase(data);
+        if (!readOnly) {
+            LOG_INFO("%s: migrating %d legacy high scores", path.c_str(), (int)n);
+            enqueue(true, data);
+        }
+        return true;
+    }
+    bool needsRewrite = false;
+    if (mappedSize > 0 &&
+        (mappedSize < (size_t)HIGHSCORE_HEADER_SIZE ||
+         getLE32(mapped + 12) != crc32(mapped, 12) ||
+         getLE16(mapped + 4) != HIGHSCORE_VERSION ||
+         getLE16(mapped + 6) != HIGHSCORE_RECORD_SIZE)) {
+        LOG_WARN("%s: bad or unsupported header, salvaging records", path.c_str());
+        needsRewrite = true;
+    }
+    int skipped = 0;
+    for (unsigned int id = 0; id < mappedRecords; id++) {
+        if (!indexRecord(id)) skipped++;
+    }
+    if (skipped > 0) {
+        LOG_WARN("%s: skipped %d corrupt records", path.c_str(), skipped);
+        needsRewrite = true;
+    }
+    if (mappedSize > 0 && mappedSize != HIGHSCORE_HEADER_SIZE + (size_t)mappedRecords * HIGHSCORE_RECORD_SIZE) {
+        LOG_WARN("%s: dropping truncated record at end of file", path.c_str());
+        needsRewrite = true;
+    }
+    if (!readOnly && (needsRewrite || (capacity > 0 && (int)mappedRecords > 2 * capacity))) compact();
+    return true;
+}
+
+bool HighScoreStore::qualifies(int score) const {
+    if (capacity <= 0 || (int)index.size() < capacity) return true;
+    return score > index.rbegin()->score;
+}
+
+bool HighScoreStore::add(const string& name, int score) {
+    HighScore hs;
+    memset(hs.name, 0, sizeof(hs.name));
+    strncpy(hs.name, name.c_str(), 19);
+    hs.score = score;
+    return addBatch(&hs, 1) == 1;
+}
+
+int HighScoreStore::addBatch(const HighScore* scores, int n) {
+    if (readOnly) return 0;
+    vector<unsigned char> records;
+    for (int i = 0; i < n; i++) {
+        if (!qualifies(scores[i].score)) continue;
+        unsigned char rec[HIGHSCORE_RECORD_SIZE];
+        memset(rec, 0, 20);
+        strncpy((char*)rec, scores[i].name, 19);
+        putLE32(rec + 20, (unsigned int)scores[i].score);
+        putLE32(rec + 24, nextSequence);
+        putLE32(rec + 28, crc32(rec, 28));
+        tail.insert(tail.end(), rec, rec + HIGHSCORE_RECORD_SIZE);
+        records.insert(records.end(), rec, rec + HIGHSCORE_RECORD_SIZE);
+        indexRecord(recordCount() - 1);
+    }
+    if (records.empty()) return 0;
+    if (capacity > 0 && (int)recordCount() > 2 * capacity) {
+        compact();
+    } else {
+        enqueue(false, records);
+        if (tail.size() >= TAIL_REMAP_BYTES) remapIfWritten();
+    }
+    return (int)(records.size() / HIGHSCORE_RECORD_SIZE);
+}
+
+// Replaces the in-memory records with `data` (header + records) and rebuilds the index
+void HighScoreStore::rebase(const vector<unsigned char>& data) {
+    unmap();
+    tail.assign(data.begin() + HIGHSCORE_HEADER_SIZE, data.end());
+    clearIndex();
+    for (unsigned int id = 0; id < recordCount(); id++) indexRecord(id);
+}
+
+// Moves the in-memory tail into the mapping, but only once the writer has
+// put every record on disk at the position the index expects.
+void HighScoreStore::remapIfWritten() {
+    {
+        lock_guard<mutex> lock(writeMutex);
+        if (writing || !jobs.empty()) return;
+    }
+    struct stat st;
+    size_t expected = HIGHSCORE_HEADER_SIZE + (size_t)recordCount() * HIGHSCORE_RECORD_SIZE;
+    if (stat(path.c_str(), &st) == 0 && (size_t)st.st_size == expected) map();
+}
+
+void HighScoreStore::compact() {
+    vector<unsigned char> data(HIGHSCORE_HEADER_SIZE + index.size() * HIGHSCORE_RECORD_SIZE);
+    encodeHeader(data.data());
+    size_t offset = HIGHSCORE_HEADER_SIZE;
+    for (const IndexKey& key : index) {
+        memcpy(&data[offset], record(key.record), HIGHSCORE_RECORD_SIZE);
+        offset += HIGHSCORE_RECORD_SIZE;
+    }
+    // record positions change: serve from memory until the new file is written
+    rebase(data);
+    enqueue(true, data);
+}
+
+void HighScoreStore::enqueue(bool rewrite, const vector<unsigned char>& data) {
+    {
+        lock_guard<mutex> lock(writeMutex);
+        jobs.push_back(WriteJob{ rewrite, data, ++queuedTicket });
+        if (!writerStarted) {
+            writerStarted = true;
+            writer = thread(&HighScoreStore::writerLoop, this);
+        }
+    }
+    writeReady.notify_one();
+}
+
+void HighScoreStore::flush() {
+    unique_lock<mutex> lock(writeMutex);
+    writeIdle.wait(lock, [this] { return jobs.empty() && !writing; });
+}
+
+unsigned long long HighScoreStore::queuedThrough() {
+    lock_guard<mutex> lock(writeMutex);
+    return queuedTicket;
+}
+
+unsigned long long HighScoreStore::writtenThrough() {
+    lock_guard<mutex> lock(writeMutex);
+    return writtenTicket;
+}
+
+void HighScoreStore::writerLoop() {
+    unique_lock<mutex> lock(writeMutex);
+    while (true) {
+        writeReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty()) break;
+        deque<WriteJob> batch;
+        batch.swap(jobs);
+        batch.insert(batch.begin(), retry.begin(), retry.end());
+        retry.clear();
+        writing = true;
+        lock.unlock();
+
+        // A rewrite already contains everything queued before it, so only the
+        // last one matters; appends after it go out together in one write.
+        size_t first = 0;
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (batch[i].rewrite) first = i;
+        }
+        bool ok = true;
+        if (batch[first].rewrite) {
+            ok = writeAtomically(batch[first].data);
+            first++;
+        }
+        vector<unsigned char> records;
+        for (size_t i = first; i < batch.size(); i++) {
+            records.insert(records.end(), batch[i].data.begin(), batch[i].data.end());
+        }
+        if (ok && !records.empty()) ok = appendRecords(records);
+
+        lock.lock();
+        writing = false;
+        if (ok) writtenTicket = batch.back().ticket;
+        else retry.swap(batch);
+        if (jobs.empty()) writeIdle.notify_all();
+        if (ok && written) {
+            lock.unlock();
+            written();
+            lock.lock();
+        }
+    }
+}
+
+// Writes a temporary file, syncs it and renames it over the store, so a
+// crash leaves either the old or the new file, never a partial one.
+bool HighScoreStore::writeAtomically(const vector<unsigned char>& data) {
+    if (appendFd >= 0) {
+        close(appendFd);
+        appendFd = -1;
+    }
+    string tmp = path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Could not open %s for writing", tmp.c_str());
+        return false;
+    }
+    bool ok = writeAll(fd, data.data(), data.size()) && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Could not replace %s", path.c_str());
+        unlink(tmp.c_str());
+        return false;
+    }
+    size_t slash = path.rfind('/');
+    string dir = slash == string::npos ? "." : path.substr(0, slash + 1);
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return true;
+}
+
+// Appends whole records; a crash mid-write leaves a torn record that load() drops.
+// A failed write is cut back off, so retrying it cannot store a record twice.
+bool HighScoreStore::appendRecords(const vector<unsigned char>& records) {
+    if (appendFd < 0) {
+        appendFd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (appendFd < 0) {
+            LOG_ERROR("Could not open %s for writing", path.c_str());
+            return false;
+        }
+    }
+    struct stat st;
+    if (fstat(appendFd, &st) != 0) st.st_size = -1;
+    if (st.st_size == 0) {
+        unsigned char header[HIGHSCORE_HEADER_SIZE];
+        encodeHeader(header);
+        if (!writeAll(appendFd, header, sizeof(header))) return false;
+    }
+    bool ok = writeAll(appendFd, records.data(), records.size()) && fdatasync(appendFd) == 0;
+    if (!ok) {
+        LOG_ERROR("Could not append to %s, will retry with the next write", path.c_str());
+        if (st.st_size >= 0) (void)!ftruncate(appendFd, st.st_size);
+    }
+    return ok;
+}
+
+HighScore HighScoreStore::toHighScore(const IndexKey& key) const {
+    HighScore hs;
+    memcpy(hs.name, record(key.record), sizeof(hs.name));
+    hs.name[19] = '\0';
+    hs.score = key.score;
+    return hs;
+}
+
+vector<HighScore> HighScoreStore::page(int offset, int n) const {
+    vector<HighScore> result;
+    if (offset < 0 || offset >= count()) return result;
+    for (auto it = index.find_by_order(offset); it != index.end() && (int)result.size() < n; ++it) {
+        result.push_back(toHighScore(*it));
+    }
+    return result;
+}
+
+int HighScoreStore::rankOf(int score) const {
+    IndexKey key = { score, 0, 0 };
+    return (int)index.order_of_key(key) + 1;
+}
+
+bool HighScoreStore::bestOf(const string& name, HighScore& best, int& rank) const {
+    auto it = bestByPlayer.find(name.substr(0, strnlen(name.c_str(), 19)));
+    if (it == bestByPlayer.end()) return false;
+    best = toHighScore(it->second);
+    rank = rankOf(best.score);
+    return true;
+}
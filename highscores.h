@@ -0,0 +1,135 @@
+/*
+ * highscores.h
+ *
+ * Leaderboard storage. The file starts with a versioned header and holds
+ * fixed-size little-endian records, each with its own CRC32, so a torn or
+ * corrupted write only loses the records it touched. New scores are
+ * appended. All disk writes happen on a background thread; rewrites go to
+ * a temporary file that is synced and renamed over the store. The file is memory-mapped and indexed by an order-statistic
+ * tree, so insert, rank and top-N queries are O(log n) and the names of
+ * entries that are never shown are never read. Files in the old
+ * raw-struct layout are migrated on load.
+ */
+
+#ifndef HIGHSCORES_H_
+#define HIGHSCORES_H_
+
+#include <condition_variable>
+#include <deque>
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+struct HighScore {
+    char name[20];
+    int score;
+};
+
+// On-disk layout, all integers little-endian:
+//   header  "RHHS" | u16 version | u16 record size | u32 flags | u32 crc32(previous 12 bytes)
+//   record  char name[20] | i32 score | u32 sequence | u32 crc32(previous 28 bytes)
+const int HIGHSCORE_VERSION = 1;
+const int HIGHSCORE_HEADER_SIZE = 16;
+const int HIGHSCORE_RECORD_SIZE = 32;
+
+unsigned int crc32(const unsigned char* data, size_t len);
+
+class HighScoreStore {
+private:
+    struct IndexKey {
+        int score;
+        unsigned int sequence;  // insertion order, breaks ties in favour of the older score
+        unsigned int record;    // position of the record in the file
+    };
+    struct Better {
+        bool operator()(const IndexKey& a, const IndexKey& b) const {
+            return a.score != b.score ? a.score > b.score : a.sequence < b.sequence;
+        }
+    };
+    typedef __gnu_pbds::tree<IndexKey, __gnu_pbds::null_type, Better, __gnu_pbds::rb_tree_tag,
+                             __gnu_pbds::tree_order_statistics_node_update> ScoreIndex;
+
+    string path;
+    int capacity;                   // 0 keeps every score
+    bool readOnly;                  // never write, not even to repair the file
+    ScoreIndex index;               // best first
+    unordered_map<string, IndexKey> bestByPlayer;   // keyed by name, at most 19 characters
+    unsigned int nextSequence;
+
+    const unsigned char* mapped;    // whole file, or nullptr
+    size_t mappedSize;
+    unsigned int mappedRecords;     // records covered by the mapping
+    vector<unsigned char> tail;     // records not covered by the mapping
+
+    // Background writer. Jobs are either records to append or a whole new file.
+    struct WriteJob {
+        bool rewrite;
+        vector<unsigned char> data;
+        unsigned long long ticket;  // numbered in the order they are queued
+    };
+    int appendFd;                   // writer thread only
+    thread writer;
+    bool writerStarted;
+    mutex writeMutex;
+    condition_variable writeReady, writeIdle;
+    deque<WriteJob> jobs;
+    bool stopping;
+    bool writing;
+    unsigned long long queuedTicket;    // last job queued
+    unsigned long long writtenTicket;   // every job up to this one is on disk
+    function<void()> written;           // called on the writer thread after each write that succeeds
+    deque<WriteJob> retry;              // writer thread only: jobs whose write failed, retried with the next ones
+
+    const unsigned char* record(unsigned int id) const;
+    unsigned int recordCount() const { return mappedRecords + (unsigned int)(tail.size() / HIGHSCORE_RECORD_SIZE); }
+    bool indexRecord(unsigned int id);
+    void clearIndex();
+    void unmap();
+    bool map();
+    void rebase(const vector<unsigned char>& data);
+    void remapIfWritten();
+    void enqueue(bool rewrite, const vector<unsigned char>& data);
+    void writerLoop();
+    bool writeAtomically(const vector<unsigned char>& data);
+    bool appendRecords(const vector<unsigned char>& records);
+    HighScore toHighScore(const IndexKey& key) const;
+public:
+    HighScoreStore(const string& file, int maxEntries = 0, bool openReadOnly = false);
+    ~HighScoreStore();
+    // Returns false when there is no file yet. Corrupt records are skipped.
+    bool load();
+    // True if a score would make it onto the leaderboard.
+    bool qualifies(int score) const;
+    // O(log n); the write to disk is queued. Returns false if the score did not make the cut.
+    bool add(const string& name, int score);
+    // Adds many scores with a single queued write. Returns how many made the cut.
+    int addBatch(const HighScore* scores, int n);
+    // Queues a rewrite of the file with only the current leaderboard, best first.
+    void compact();
+    // Blocks until every queued write is on disk.
+    void flush();
+    // Ticket of the last queued write; it is on disk once writtenThrough() reaches it.
+    unsigned long long queuedThrough();
+    unsigned long long writtenThrough();
+    // Called on the writer thread whenever writtenThrough() advances. Set before anything is queued.
+    void onWritten(const function<void()>& callback) { written = callback; }
+    int count() const { return (int)index.size(); }
+    // Number of entries with a score strictly above `score`.
+    int countAbove(int score) const { return rankOf(score) - 1; }
+    // Entries [offset, offset + n) in rank order.
+    vector<HighScore> page(int offset, int n) const;
+    vector<HighScore> top(int n) const { return page(0, n); }
+    // 1-based competition rank of a score: one more than the number of higher scores.
+    int rankOf(int score) const;
+    // Player's best entry and its rank; false if the player has no score.
+    bool bestOf(const string& name, HighScore& best, int& rank) const;
+    const string& getPath() const { return path; }
+};
+
+#endif /* HIGHSCORES_H_ */
@@ -0,0 +1,26 @@
+/*
+ * image.cpp
+ *
+ */
+#include "image.h"
+#include "CImg.h"
+
+void ReadImage(string imgname, vector<unsigned char> &imgArray) {
+	using namespace cimg_library;
+	CImg<unsigned char> img(imgname.c_str());
+	imgArray.resize(img.height() * img.width() * 3, 0);
+	int k = 0;
+	unsigned char *rp = img.data();
+	unsigned char *gp = img.data() + img.height() * img.width();
+	unsigned char *bp = gp + img.height() * img.width();
+
+	for (int j = 0; j < img.width(); ++j) {
+		int t = j;
+		for (int i = 0; i < img.height(); ++i, t += img.width()) {
+			imgArray[k++] = rp[t];
+			imgArray[k++] = gp[t];
+			imgArray[k++] = bp[t];
+		}
+		//imgArray[i][j] = img[k++];
+	}
+}
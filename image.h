@@ -0,0 +1,21 @@
+/*
+ * image.h
+ *
+ * Image loading. Only image.cpp includes CImg.h, which is large enough
+ * that parsing it dominated the build time of every file that used to
+ * see it through util.h.
+ */
+
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include <string>
+#include <vector>
+using namespace std;
+
+// function reads the image and give the pixels in
+// column major order, every pixel is placed linearly
+// in Reg, Green, Blue format and then columnwise same as opengl...
+void ReadImage(string imgname, vector<unsigned char> &imgArray);
+
+#endif /* IMAGE_H_ */
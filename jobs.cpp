@@ -0,0 +1,107 @@
+/*
+ * jobs.cpp
+ *
+ */
+#include "jobs.h"
+#include <algorithm>
+
+// 0 on threads the system does not own, i + 1 on worker i
+static thread_local int workerIndex = 0;
+static thread_local const JobSystem* workerOf = nullptr;
+
+JobSystem::JobSystem(int numWorkers) : queued(0), stopping(false) {
+    if (numWorkers < 0) numWorkers = max(0, (int)thread::hardware_concurrency() - 1);
+    for (int i = 0; i <= numWorkers; i++) queues.push_back(unique_ptr<Queue>(new Queue()));
+    for (int i = 1; i <= numWorkers; i++) workers.push_back(thread(&JobSystem::work, this, i));
+}
+
+JobSystem::~JobSystem() {
+    {
+        lock_guard<mutex> guard(sleepLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+int JobSystem::queueIndex() const {
+    return workerOf == this ? workerIndex : 0;
+}
+
+void JobSystem::run(const Job& job, JobCounter& done) {
+    done.pending.fetch_add(1, memory_order_relaxed);
+    Job counted = [job, &done]() {
+        job();
+        done.pending.fetch_sub(1, memory_order_release);
+    };
+    Queue& queue = *queues[queueIndex()];
+    {
+        lock_guard<mutex> guard(queue.lock);
+        queue.jobs.push_back(counted);
+    }
+    {
+        lock_guard<mutex> guard(sleepLock);
+        queued++;
+    }
+    wake.notify_one();
+}
+
+// Own queue newest first (its data is likely still in cache), then the
+// oldest job of every other queue in turn
+bool JobSystem::runOne(int self) {
+    Job job;
+    for (size_t k = 0; k < queues.size() && !job; k++) {
+        Queue& queue = *queues[(self + k) % queues.size()];
+        lock_guard<mutex> guard(queue.lock);
+        if (queue.jobs.empty()) continue;
+        if (k == 0) {
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+        } else {
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+        }
+    }
+    if (!job) return false;
+    {
+        lock_guard<mutex> guard(sleepLock);
+        queued--;
+    }
+    job();
+    return true;
+}
+
+void JobSystem::work(int self) {
+    workerIndex = self;
+    workerOf = this;
+    while (true) {
+        if (runOne(self)) continue;
+        unique_lock<mutex> lock(sleepLock);
+        wake.wait(lock, [this]() { return stopping || queued > 0; });
+        if (stopping) return;
+    }
+}
+
+void JobSystem::wait(JobCounter& done) {
+    int self = queueIndex();
+    while (done.pending.load(memory_order_acquire) > 0) {
+        if (!runOne(self)) this_thread::yield();
+    }
+}
+
+void JobSystem::parallelFor(int count, int grain, const function<void(int, int)>& body) {
+    if (count <= 0) return;
+    // a few ranges per thread, so a thread that finishes early can steal
+    int size = max(max(grain, 1), (count + threadCount() * 4 - 1) / (threadCount() * 4));
+    if (workers.empty() || size >= count) {
+        body(0, count);
+        return;
+    }
+    JobCounter done;
+    for (int begin = size; begin < count; begin += size) {
+        int end = min(count, begin + size);
+        run([&body, begin, end]() { body(begin, end); }, done);
+    }
+    body(0, size);
+    wait(done);
+}
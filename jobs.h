@@ -0,0 +1,70 @@
+/*
+ * jobs.h
+ *
+ * A small work-stealing job system for the per-tick simulation work.
+ * Every thread has its own queue: it pushes and pops jobs at the back,
+ * and an idle thread steals from the front of someone else's. A thread
+ * waiting for jobs to finish runs queued jobs itself instead of blocking,
+ * so jobs may start and wait for other jobs (that is how dependencies
+ * are expressed), and a system with no workers at all still works: the
+ * waiting thread just does everything.
+ *
+ * Nothing here merges results. Jobs write to slots that belong to them
+ * (element i of an output vector for item i); the caller combines them
+ * in index order afterwards, so the outcome does not depend on how many
+ * threads ran or which job finished first.
+ */
+
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Counts unfinished jobs; wait on it to depend on all of them
+struct JobCounter {
+    atomic<int> pending;
+    JobCounter() : pending(0) {}
+};
+
+class JobSystem {
+public:
+    typedef function<void()> Job;
+private:
+    struct Queue {
+        mutex lock;
+        deque<Job> jobs;
+    };
+    vector<unique_ptr<Queue> > queues;  // [0] for threads outside the system, then one per worker
+    vector<thread> workers;
+    mutex sleepLock;
+    condition_variable wake;
+    int queued;                         // jobs in all queues; guarded by sleepLock
+    bool stopping;
+
+    int queueIndex() const;
+    bool runOne(int self);
+    void work(int self);
+public:
+    // workers < 0: one per core beyond the calling thread's
+    explicit JobSystem(int workers = -1);
+    ~JobSystem();
+    // Threads that run jobs while someone waits: the workers and the waiter
+    int threadCount() const { return (int)workers.size() + 1; }
+    // Queues job; done.pending drops by one when it has run
+    void run(const Job& job, JobCounter& done);
+    // Runs queued jobs on this thread until everything counted by done has run
+    void wait(JobCounter& done);
+    // Calls body(begin, end) over [0, count) in ranges of at least grain
+    // items, one of them on this thread; returns when all have run.
+    void parallelFor(int count, int grain, const function<void(int, int)>& body);
+};
+
+#endif /* JOBS_H_ */
@@ -0,0 +1,71 @@
+/*
+ * latency.cpp
+ *
+ */
+#include "latency.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+LatencyTracker inputLatency;
+
+static long long nowUs() {
+    return chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void LatencyTracker::onInput() {
+    lock_guard<mutex> guard(lock);
+    if (numWaiting < MAX_IN_FLIGHT) waiting[numWaiting++] = nowUs();
+}
+
+void LatencyTracker::onTick(long long tick) {
+    lock_guard<mutex> guard(lock);
+    long long now = nowUs();
+    for (int i = 0; i < numWaiting && numApplied < MAX_IN_FLIGHT; i++) {
+        applied[numApplied][0] = waiting[i];
+        applied[numApplied][1] = now;
+        applied[numApplied][2] = tick;
+        numApplied++;
+    }
+    numWaiting = 0;
+}
+
+void LatencyTracker::onPresent(long long shownTick) {
+    lock_guard<mutex> guard(lock);
+    if (numApplied == 0) return;
+    long long now = nowUs();
+    int kept = 0;
+    for (int i = 0; i < numApplied; i++) {
+        if (applied[i][2] > shownTick) {
+            for (int k = 0; k < 3; k++) applied[kept][k] = applied[i][k];
+            kept++;
+            continue;
+        }
+        int slot = totalSamples % MAX_SAMPLES;
+        samples[INPUT_TO_TICK][slot] = applied[i][1] - applied[i][0];
+        samples[TICK_TO_PRESENT][slot] = now - applied[i][1];
+        samples[INPUT_TO_PRESENT][slot] = now - applied[i][0];
+        totalSamples++;
+    }
+    numApplied = kept;
+}
+
+long long LatencyTracker::percentile(Stage stage, double p) const {
+    lock_guard<mutex> guard(lock);
+    int n = totalSamples < MAX_SAMPLES ? (int)totalSamples : MAX_SAMPLES;
+    if (n == 0) return 0;
+    vector<long long> sorted(samples[stage], samples[stage] + n);
+    int k = (int)(p / 100.0 * (n - 1) + 0.5);
+    nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+}
+
+string LatencyTracker::summary() const {
+    char buf[160];
+    snprintf(buf, sizeof(buf), "input->photon p50 %.1f ms p99 %.1f ms (wait for tick p50 %.1f, tick->swap p50 %.1f, n=%lld)",
+             percentile(INPUT_TO_PRESENT, 50) / 1000.0, percentile(INPUT_TO_PRESENT, 99) / 1000.0,
+             percentile(INPUT_TO_TICK, 50) / 1000.0, percentile(TICK_TO_PRESENT, 50) / 1000.0, totalSamples);
+    return buf;
+}
@@ -0,0 +1,49 @@
+/*
+ * latency.h
+ *
+ * Input-to-photon latency. Every input is timestamped when its callback
+ * runs, marked with the simulation tick that applies it, and closed when
+ * glutSwapBuffers returns on the first frame drawn from that tick's
+ * snapshot or a later one. Inputs and frames
+ * are reported from the main thread and ticks from the simulation thread,
+ * so every call takes a lock.
+ */
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <mutex>
+#include <string>
+using namespace std;
+
+class LatencyTracker {
+public:
+    static const int MAX_IN_FLIGHT = 64;
+    static const int MAX_SAMPLES = 8192;
+    enum Stage { INPUT_TO_TICK, TICK_TO_PRESENT, INPUT_TO_PRESENT, STAGE_COUNT };
+private:
+    mutable mutex lock;
+    long long waiting[MAX_IN_FLIGHT];       // arrival times not yet applied by a tick
+    int numWaiting;
+    long long applied[MAX_IN_FLIGHT][3];    // {arrival, tick time, tick number} waiting for a frame
+    int numApplied;
+    long long samples[STAGE_COUNT][MAX_SAMPLES];   // ring buffers, microseconds
+    long long totalSamples;
+public:
+    LatencyTracker() : numWaiting(0), numApplied(0), totalSamples(0) {}
+    // Input callback queued state for the next simulation tick
+    void onInput();
+    // Simulation tick number `tick` is consuming everything queued so far
+    void onTick(long long tick);
+    // A frame drawn from the snapshot of tick number `shownTick` was
+    // swapped; inputs applied by later ticks wait for a later frame
+    void onPresent(long long shownTick);
+    long long count() const { return totalSamples; }
+    // p in [0, 100]; returns microseconds, 0 when there are no samples
+    long long percentile(Stage stage, double p) const;
+    string summary() const;
+};
+
+extern LatencyTracker inputLatency;
+
+#endif /* LATENCY_H_ */
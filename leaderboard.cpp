@@ -0,0 +1,204 @@
+/*
+ * leaderboard.cpp
+ *
+ * Command-line queries over one or more high-score files, e.g. copies
+ * pulled from several machines. Files are opened read-only and treated
+ * as one combined leaderboard. Needs neither SDL nor GLUT.
+ *
+ *   leaderboard [-f FILE]... top [N]
+ *   leaderboard [-f FILE]... rank NAME
+ *   leaderboard [-f FILE]... percentile SCORE
+ *   leaderboard [-f FILE]... histogram [BUCKET_WIDTH]
+ *   leaderboard [-s SOCKET] flood COUNT [CLIENTS]
+ */
+#include "highscores.h"
+#include "log.h"
+#include "scoreservice.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <thread>
+#include <unistd.h>
+
+static vector<unique_ptr<HighScoreStore> > stores;
+
+static int usage() {
+    fprintf(stderr,
+            "usage: leaderboard [-f FILE]... COMMAND\n"
+            "  top [N]                  best N scores (default 10)\n"
+            "  rank NAME                a player's best score and rank\n"
+            "  percentile SCORE         share of scores below SCORE\n"
+            "  histogram [WIDTH]        score distribution in buckets of WIDTH\n"
+            "  flood COUNT [CLIENTS]    load-test the score service with COUNT submissions\n"
+            "FILE defaults to highscores.txt, SOCKET to " DEFAULT_SCORE_SOCKET "\n");
+    return 2;
+}
+
+static long long totalCount() {
+    long long n = 0;
+    for (auto& s : stores) n += s->count();
+    return n;
+}
+
+static long long totalAbove(int score) {
+    long long n = 0;
+    for (auto& s : stores) n += s->countAbove(score);
+    return n;
+}
+
+static bool better(const HighScore& a, const HighScore& b) {
+    return a.score > b.score;
+}
+
+static int cmdTop(int n) {
+    vector<HighScore> all;
+    for (auto& s : stores) {
+        vector<HighScore> part = s->top(n);
+        all.insert(all.end(), part.begin(), part.end());
+    }
+    stable_sort(all.begin(), all.end(), better);
+    if ((int)all.size() > n) all.resize(n);
+    for (size_t i = 0; i < all.size(); i++) {
+        printf("%4lld. %-19s %d\n", totalAbove(all[i].score) + 1, all[i].name, all[i].score);
+    }
+    return 0;
+}
+
+static int cmdRank(const string& name) {
+    HighScore best;
+    bool found = false;
+    for (auto& s : stores) {
+        HighScore hs;
+        int r;
+        if (s->bestOf(name, hs, r) && (!found || hs.score > best.score)) {
+            best = hs;
+            found = true;
+        }
+    }
+    if (!found) {
+        printf("%s has no scores\n", name.c_str());
+        return 1;
+    }
+    printf("%s: best %d, rank %lld of %lld\n", best.name, best.score, totalAbove(best.score) + 1, totalCount());
+    return 0;
+}
+
+static int cmdPercentile(int score) {
+    long long total = totalCount();
+    if (total == 0) {
+        printf("no scores\n");
+        return 1;
+    }
+    long long atLeast = score == INT_MIN ? total : totalAbove(score - 1);
+    printf("%d beats %.2f%% of %lld scores\n", score, 100.0 * (total - atLeast) / total, total);
+    return 0;
+}
+
+static int cmdHistogram(int width) {
+    long long total = totalCount();
+    if (total == 0) {
+        printf("no scores\n");
+        return 1;
+    }
+    int hi = INT_MIN, lo = INT_MAX;
+    for (auto& s : stores) {
+        if (s->count() == 0) continue;
+        hi = max(hi, s->page(0, 1)[0].score);
+        lo = min(lo, s->page(s->count() - 1, 1)[0].score);
+    }
+    long long range = (long long)hi - lo + 1;
+    if (width <= 0) width = (int)max(1LL, (range + 19) / 20);
+    long long peak = 0;
+    vector<pair<long long, long long> > buckets; // {lower bound, count}
+    for (long long b = lo; b <= hi; b += width) {
+        // entries in [b, b + width) = above(b - 1) - above(b + width - 1)
+        long long upper = min(b + width - 1, (long long)INT_MAX);
+        long long n = (b == INT_MIN ? total : totalAbove((int)(b - 1))) - totalAbove((int)upper);
+        buckets.push_back(make_pair(b, n));
+        peak = max(peak, n);
+    }
+    for (auto& bucket : buckets) {
+        int bar = peak > 0 ? (int)(50 * bucket.second / peak) : 0;
+        printf("%8lld..%-8lld %9lld %s\n", bucket.first, bucket.first + width - 1, bucket.second, string(bar, '#').c_str());
+    }
+    return 0;
+}
+
+// Sends `count` submissions per client over one connection each, then waits
+// for a query to come back, which the service only answers once every
+// earlier submission has been applied.
+static int cmdFlood(const string& socketPath, int count, int clients) {
+    if (count <= 0 || clients <= 0) return usage();
+    int before = 0;
+    vector<HighScore> page;
+    if (!scoreServicePage(socketPath, 0, 0, page, before)) {
+        fprintf(stderr, "score service not reachable at %s\n", socketPath.c_str());
+        return 1;
+    }
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> senders;
+    for (int c = 0; c < clients; c++) {
+        senders.emplace_back([&socketPath, count, c]() {
+            int fd = scoreServiceConnect(socketPath);
+            if (fd < 0) return;
+            // a load test should block on a busy service, not time out
+            timeval blocking = { 0, 0 };
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &blocking, sizeof(blocking));
+            string batch, prefix = scoreSubmissionId() + ".";
+            for (int i = 0; i < count; i++) {
+                batch += "SUBMIT " + prefix + to_string(i) + " " + to_string(rand() % 100000) + " flood" + to_string(c) + "\n";
+                if (batch.size() >= 64 * 1024 || i == count - 1) {
+                    if (send(fd, batch.data(), batch.size(), MSG_NOSIGNAL) != (ssize_t)batch.size()) break;
+                    batch.clear();
+                }
+            }
+            close(fd);
+        });
+    }
+    for (thread& t : senders) t.join();
+    int after = before;
+    scoreServicePage(socketPath, 0, 0, page, after);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long long sent = (long long)count * clients;
+    printf("%lld submissions from %d clients in %.3f s: %.0f/s, leaderboard %d -> %d\n",
+           sent, clients, seconds, sent / seconds, before, after);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    vector<string> files;
+    string socketPath = DEFAULT_SCORE_SOCKET;
+    int arg = 1;
+    while (arg + 1 < argc && (strcmp(argv[arg], "-f") == 0 || strcmp(argv[arg], "-s") == 0)) {
+        if (argv[arg][1] == 'f') files.push_back(argv[arg + 1]);
+        else socketPath = argv[arg + 1];
+        arg += 2;
+    }
+    if (files.empty()) files.push_back("highscores.txt");
+    if (arg >= argc) return usage();
+    if (strcmp(argv[arg], "flood") == 0) {
+        if (arg + 1 >= argc) return usage();
+        return cmdFlood(socketPath, atoi(argv[arg + 1]), arg + 2 < argc ? atoi(argv[arg + 2]) : 1);
+    }
+    logStart();
+    for (const string& file : files) {
+        stores.emplace_back(new HighScoreStore(file, 0, true));
+        if (!stores.back()->load()) LOG_WARN("%s: not found", file.c_str());
+    }
+    string command = argv[arg];
+    const char* param = arg + 1 < argc ? argv[arg + 1] : nullptr;
+    int status;
+    if (command == "top") status = cmdTop(param ? atoi(param) : 10);
+    else if (command == "rank" && param) status = cmdRank(param);
+    else if (command == "percentile" && param) status = cmdPercentile(atoi(param));
+    else if (command == "histogram") status = cmdHistogram(param ? atoi(param) : 0);
+    else status = usage();
+    logShutdown();
+    return status;
+}
@@ -0,0 +1,147 @@
+/*
+ * log.cpp
+ *
+ */
+#include "log.h"
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <unistd.h>
+using namespace std;
+
+namespace {
+
+const unsigned long RING_SIZE = 1024; // must be a power of two
+const int MESSAGE_SIZE = 200;
+const int BATCH_SIZE = 64 * 1024;
+
+// A slot's sequence is 2*lap while it is free for lap `lap` of the ring and
+// 2*lap+1 once a message for that lap has been published. Zero-initialised
+// slots are therefore all free for the first lap.
+struct LogSlot {
+    atomic<unsigned long> sequence;
+    int level;
+    long long timeUs;
+    char text[MESSAGE_SIZE];
+};
+
+LogSlot ring[RING_SIZE];
+atomic<unsigned long> enqueuePos(0);
+unsigned long dequeuePos = 0; // only touched by the writer
+atomic<int> runtimeLevel(LOG_LEVEL_INFO);
+atomic<unsigned long> dropped(0);
+atomic<bool> running(false);
+thread writer;
+const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+const char* levelName(int level) {
+    switch (level) {
+        case LOG_LEVEL_DEBUG: return "DEBUG";
+        case LOG_LEVEL_INFO: return "INFO ";
+        case LOG_LEVEL_WARN: return "WARN ";
+        default: return "ERROR";
+    }
+}
+
+void writeAll(const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(STDERR_FILENO, data, len);
+        if (n <= 0) return;
+        data += n;
+        len -= n;
+    }
+}
+
+// Formats every published message into one buffer and writes it in a single call.
+// Returns the number of messages written.
+int drainBatch() {
+    static char batch[BATCH_SIZE];
+    size_t len = 0;
+    int written = 0;
+    while (true) {
+        LogSlot& slot = ring[dequeuePos & (RING_SIZE - 1)];
+        unsigned long lap = dequeuePos / RING_SIZE;
+        if (slot.sequence.load(memory_order_acquire) != 2 * lap + 1) break;
+        if (len + MESSAGE_SIZE + 32 > sizeof(batch)) {
+            writeAll(batch, len);
+            len = 0;
+        }
+        int n = snprintf(batch + len, sizeof(batch) - len, "[%9.3f] %s %s\n",
+                         slot.timeUs / 1e6, levelName(slot.level), slot.text);
+        len += n < 0 ? 0 : n;
+        slot.sequence.store(2 * (lap + 1), memory_order_release);
+        dequeuePos++;
+        written++;
+    }
+    if (len > 0) writeAll(batch, len);
+    return written;
+}
+
+void writerLoop() {
+    while (running.load(memory_order_acquire)) {
+        if (drainBatch() == 0) {
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+    }
+    drainBatch();
+}
+
+} // namespace
+
+void logStart() {
+    if (running.exchange(true)) return;
+    writer = thread(writerLoop);
+}
+
+void logShutdown() {
+    if (running.exchange(false)) {
+        writer.join();
+    } else {
+        drainBatch();
+    }
+    // written directly: the ring is what overflowed
+    unsigned long lost = dropped.load(memory_order_relaxed);
+    if (lost > 0) {
+        char line[96];
+        double seconds = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - epoch).count() / 1e6;
+        int n = snprintf(line, sizeof(line), "[%9.3f] %s %lu log messages dropped: the ring buffer was full\n",
+                         seconds, levelName(LOG_LEVEL_WARN), lost);
+        writeAll(line, n);
+    }
+}
+
+void logSetLevel(int level) { runtimeLevel.store(level, memory_order_relaxed); }
+
+int logGetLevel() { return runtimeLevel.load(memory_order_relaxed); }
+
+unsigned long logDroppedCount() { return dropped.load(memory_order_relaxed); }
+
+void logWrite(int level, const char* fmt, ...) {
+    if (level < runtimeLevel.load(memory_order_relaxed)) return;
+    unsigned long pos = enqueuePos.load(memory_order_relaxed);
+    LogSlot* slot;
+    while (true) {
+        slot = &ring[pos & (RING_SIZE - 1)];
+        unsigned long seq = slot->sequence.load(memory_order_acquire);
+        unsigned long freeSeq = 2 * (pos / RING_SIZE);
+        if (seq == freeSeq) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) break;
+        } else if (seq < freeSeq) {
+            // writer has not caught up with the previous lap: drop instead of blocking
+            dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        } else {
+            pos = enqueuePos.load(memory_order_relaxed);
+        }
+    }
+    slot->level = level;
+    slot->timeUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - epoch).count();
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(slot->text, MESSAGE_SIZE, fmt, args);
+    va_end(args);
+    slot->sequence.store(2 * (pos / RING_SIZE) + 1, memory_order_release);
+}
@@ -0,0 +1,62 @@
+/*
+ * log.h
+ *
+ * Asynchronous logger. Callers format their message into a slot of a
+ * lock-free ring buffer and return immediately; a background thread adds
+ * the timestamp and level and writes whole batches to stderr.
+ *
+ * Build with -DLOG_COMPILE_LEVEL=LOG_LEVEL_WARN (for example) to compile
+ * out every LOG_* call below that level.
+ */
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+// Starts the writer thread. Messages logged before this are still queued.
+void logStart();
+// Drains everything queued so far and stops the writer thread, then
+// reports how many messages were dropped, if any.
+void logShutdown();
+// Messages below this level are discarded before formatting (default INFO).
+void logSetLevel(int level);
+int logGetLevel();
+// Number of messages lost because the ring buffer was full.
+unsigned long logDroppedCount();
+
+void logWrite(int level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) logWrite(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) logWrite(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) logWrite(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) logWrite(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+#endif /* LOG_H_ */
@@ -0,0 +1,23 @@
+/*
+ * offscreen.h
+ *
+ * A GL context without a window, so frame times can be measured on
+ * machines with no display. It is an EGL pbuffer with a compatibility
+ * profile context, which Mesa's software rasteriser provides anywhere,
+ * set up with the same projection as the game window. GLUT's bitmap
+ * fonts need glutInit and a window, so DrawString cannot be used here.
+ */
+
+#ifndef OFFSCREEN_H_
+#define OFFSCREEN_H_
+
+#include <string>
+using namespace std;
+
+// False if EGL or desktop GL is unavailable.
+bool offscreenOpen(int width, int height);
+void offscreenClose();
+// GL_RENDERER of the open context, e.g. "llvmpipe (LLVM 15.0.6, 256 bits)".
+string offscreenRenderer();
+
+#endif /* OFFSCREEN_H_ */
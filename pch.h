@@ -0,0 +1,27 @@
+/*
+ * pch.h
+ *
+ * Precompiled header for the objects that use GL or SDL: the system and
+ * library headers they all parse, none of ours, so editing a game header
+ * never invalidates it. The Makefile force-includes it; sources still
+ * include what they use.
+ */
+
+#ifndef PCH_H_
+#define PCH_H_
+
+#include <GL/gl.h>
+#include <GL/glut.h>
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_mixer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <future>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#endif /* PCH_H_ */
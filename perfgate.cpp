@@ -0,0 +1,329 @@
+/*
+ * perfgate.cpp
+ *
+ * Performance regression gate. Runs a fixed set of workloads through the
+ * simulation and the offscreen renderer: the recorded games in
+ * perf/replays, autopilot games and traffic stress scenarios, each from a
+ * fixed seed so every run does the same work. Each workload is run
+ * several times and its fastest run is compared with the baseline file;
+ * the gate fails if tick or frame time got slower by more than the
+ * threshold, still after two more attempts. Frames get a wider threshold
+ * than ticks because software GL timings are much noisier; llvmpipe is
+ * asked to rasterise on the calling thread to keep them steadier.
+ * Baselines are scaled by a calibration loop timed at the start of every
+ * run. Baselines are per machine: regenerate them with --update
+ * (make perf-baseline) after an intended change or on new hardware.
+ *
+ *   perfgate [--baseline=FILE] [--update] [--threshold=PCT] [--frame-threshold=PCT]
+ *            [--runs=N] [--replays=DIR] [--only=NAME]
+ *   perfgate --record=DIR      write autopilot games as replays to DIR
+ */
+#include "autopilot.h"
+#include "events.h"
+#include "log.h"
+#include "offscreen.h"
+#include "replay.h"
+#include "world.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+static const int WIDTH = 680, HEIGHT = 720;
+static const int PLAYER_SPEED = 20;
+
+struct Scenario {
+    string name;
+    unsigned int seed;
+    bool taxi;
+    int traffic;
+    int ticks;
+    bool autopilot;         // otherwise the player stays parked
+    int frameEvery;         // software GL is slow, so only every Nth tick is drawn
+    string replayPath;      // recorded game: every tick starts from the recorded state
+};
+
+// Mean cost of one tick and one frame in a run, in nanoseconds
+struct Timing {
+    double tickNs, frameNs;
+};
+
+static bool rendering = false;
+static string renderer = "none";
+
+static double nowNs() {
+    return (double)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Same path as the game: snapshot the world, then draw the snapshot
+static void drawFrame(const World& world) {
+    static WorldSnapshot snapshot;
+    world.snapshot(snapshot);
+    glClearColor(0.2, 0.2, 0.2, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+    snapshot.draw();
+    glFinish();
+}
+
+// Starting layout of a recorded game, taken from its first frame
+static WorldLayout layoutOf(const ReplayFrame& frame) {
+    WorldLayout layout;
+    for (int i = 1; i < frame.numCars; i++) layout.traffic.push_back({ frame.carX[i], frame.carY[i] });
+    for (int i = 0; i < REPLAY_STATIONS; i++) layout.stations[i] = { frame.stationX[i], frame.stationY[i] };
+    layout.numItems = frame.numItems;
+    for (int i = 0; i < frame.numItems; i++) layout.items[i] = { frame.itemX[i], frame.itemY[i] };
+    return layout;
+}
+
+static Timing run(const Scenario& scenario) {
+    World world;
+    ReplayReader recording;
+    ReplayFrame frame;
+    int ticks = scenario.ticks;
+    srand(scenario.seed);
+    if (!scenario.replayPath.empty()) {
+        if (!recording.open(scenario.replayPath) || !recording.seek(0, frame)) return Timing{ 0, 0 };
+        ticks = recording.tickCount();
+        world.populate(layoutOf(frame), recording.getRole() == REPLAY_TAXI);
+    } else {
+        world.populate(generateWorld(scenario.traffic), scenario.taxi);
+    }
+    Autopilot autopilot(PLAYER_SPEED);
+    double tickNs = 0, frameNs = 0;
+    int frames = 0;
+    for (int t = 0; t < ticks; t++) {
+        AutopilotMove move = { 0, 0, false, false };
+        if (!scenario.replayPath.empty()) {
+            recording.seek(t, frame);
+            world.restore(frame);
+        } else if (scenario.autopilot) {
+            move = autopilot.decide(world);
+        }
+        double start = nowNs();
+        if (move.refuel) world.refuel();
+        if (move.action) world.pickUpOrDropOff();
+        world.movePlayer(move.dx, move.dy, PLAYER_SPEED);
+        world.moveTraffic();
+        world.resolveCollisions();
+        gameEvents.dispatch();
+        double ticked = nowNs();
+        tickNs += ticked - start;
+        if (rendering && t % scenario.frameEvery == 0) {
+            drawFrame(world);
+            frameNs += nowNs() - ticked;
+            frames++;
+        }
+    }
+    return Timing{ tickNs / ticks, frames > 0 ? frameNs / frames : 0 };
+}
+
+// A fixed integer workload; its time scales the baselines, so a machine
+// that is uniformly slower today than when they were written is not a regression
+static double calibrate() {
+    double best = 0;
+    for (int r = 0; r < 5; r++) {
+        double start = nowNs();
+        unsigned int h = 2166136261u;
+        for (int i = 0; i < 2000000; i++) h = (h ^ (unsigned int)i) * 16777619u;
+        double elapsed = nowNs() - start;
+        if (h == 42) printf(" ");     // keeps the loop
+        if (r == 0 || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+// Fastest of `runs` runs
+static Timing measure(const Scenario& scenario, int runs) {
+    Timing best = run(scenario);
+    for (int r = 1; r < runs; r++) {
+        Timing t = run(scenario);
+        best.tickNs = min(best.tickNs, t.tickNs);
+        best.frameNs = min(best.frameNs, t.frameNs);
+    }
+    return best;
+}
+
+// Allowed slowdown in percent, per metric
+static double thresholds[2] = { 30, 75 };
+static const char* metrics[2] = { "tick", "frame" };
+
+static bool slower(const string& name, const Timing& timing, const map<string, double>& baseline, double scale) {
+    double values[2] = { timing.tickNs, timing.frameNs };
+    for (int m = 0; m < (rendering ? 2 : 1); m++) {
+        map<string, double>::const_iterator base = baseline.find(name + " " + metrics[m]);
+        if (base != baseline.end() && values[m] > base->second * scale * (1 + thresholds[m] / 100)) return true;
+    }
+    return false;
+}
+
+static vector<Scenario> scenarios(const string& replayDir) {
+    vector<Scenario> list;
+    vector<string> files;
+    if (DIR* dir = opendir(replayDir.c_str())) {
+        while (dirent* entry = readdir(dir)) {
+            string name = entry->d_name;
+            if (name.size() > 5 && name.compare(name.size() - 5, 5, ".rhrp") == 0) files.push_back(name);
+        }
+        closedir(dir);
+    }
+    sort(files.begin(), files.end());
+    for (size_t i = 0; i < files.size(); i++) {
+        list.push_back({ "replay:" + files[i].substr(0, files[i].size() - 5), 7, true, 0, 0, false, 10, replayDir + "/" + files[i] });
+    }
+    list.push_back({ "taxi-autopilot", 101, true, 4, 1800, true, 10, "" });
+    list.push_back({ "delivery-autopilot", 202, false, 4, 1800, true, 10, "" });
+    // every road cell but the player's holds a car: constant collisions and respawns
+    list.push_back({ "traffic-144", 303, true, 144, 1800, false, 60, "" });
+    return list;
+}
+
+// "scenario metric" -> value
+static map<string, double> readBaseline(const string& path) {
+    map<string, double> baseline;
+    ifstream in(path);
+    string line;
+    while (getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        istringstream fields(line);
+        string scenario, metric;
+        double value;
+        if (fields >> scenario >> metric >> value) baseline[scenario + " " + metric] = value;
+    }
+    return baseline;
+}
+
+static bool writeBaseline(const string& path, const map<string, double>& results, double calibration) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) return false;
+    fprintf(out, "# perfgate baselines: scenario, metric, fastest run in ns; regenerate with make perf-baseline\n");
+    fprintf(out, "# renderer: %s\n", renderer.c_str());
+    fprintf(out, "calibration ns %.0f\n", calibration);
+    for (map<string, double>::const_iterator it = results.begin(); it != results.end(); ++it) {
+        fprintf(out, "%s %.0f\n", it->first.c_str(), it->second);
+    }
+    return fclose(out) == 0;
+}
+
+// Plays autopilot games and keeps them as replays, to seed perf/replays
+static int record(const string& dir) {
+    const Scenario games[] = {
+        { "taxi", 11, true, 4, 1800, true, 1, "" },
+        { "delivery", 22, false, 4, 1800, true, 1, "" },
+    };
+    for (const Scenario& game : games) {
+        srand(game.seed);
+        World world;
+        world.populate(generateWorld(game.traffic), game.taxi);
+        Autopilot autopilot(PLAYER_SPEED);
+        ReplayRecorder recorder;
+        string path = dir + "/autopilot-" + game.name + ".rhrp";
+        if (!recorder.open(path, game.taxi ? REPLAY_TAXI : REPLAY_DELIVERY, 100)) return 1;
+        ReplayFrame frame;
+        for (int t = 0; t < game.ticks; t++) {
+            AutopilotMove move = autopilot.decide(world);
+            if (move.refuel) world.refuel();
+            if (move.action) world.pickUpOrDropOff();
+            world.movePlayer(move.dx, move.dy, PLAYER_SPEED);
+            world.moveTraffic();
+            world.resolveCollisions();
+            gameEvents.dispatch();
+            world.capture(frame);
+            recorder.record(frame);
+        }
+        recorder.close();
+        printf("wrote %s (score %d)\n", path.c_str(), world.player->getScore());
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    string baselinePath = "perf/baselines.txt", replayDir = "perf/replays", recordDir, only;
+    bool update = false;
+    int runs = 5;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--baseline=", 11) == 0) baselinePath = arg + 11;
+        else if (strcmp(arg, "--update") == 0) update = true;
+        else if (strncmp(arg, "--threshold=", 12) == 0) thresholds[0] = atof(arg + 12);
+        else if (strncmp(arg, "--frame-threshold=", 18) == 0) thresholds[1] = atof(arg + 18);
+        else if (strncmp(arg, "--runs=", 7) == 0) runs = max(1, atoi(arg + 7));
+        else if (strncmp(arg, "--replays=", 10) == 0) replayDir = arg + 10;
+        else if (strncmp(arg, "--record=", 9) == 0) recordDir = arg + 9;
+        else if (strncmp(arg, "--only=", 7) == 0) only = arg + 7;
+        else {
+            fprintf(stderr, "usage: perfgate [--baseline=FILE] [--update] [--threshold=PCT] [--frame-threshold=PCT]\n"
+                            "                [--runs=N] [--replays=DIR] [--only=NAME]\n"
+                            "       perfgate --record=DIR\n");
+            return 2;
+        }
+    }
+    logSetLevel(LOG_LEVEL_WARN);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    if (!recordDir.empty()) return record(recordDir);
+
+    setenv("LP_NUM_THREADS", "0", 0);
+    rendering = offscreenOpen(WIDTH, HEIGHT);
+    if (rendering) renderer = offscreenRenderer();
+    printf("renderer: %s; fastest of %d runs, mean per tick and per frame\n",
+           rendering ? renderer.c_str() : "none (frame times not measured)", runs);
+    map<string, double> baseline = readBaseline(baselinePath);
+    double calibration = calibrate();
+    map<string, double>::const_iterator then = baseline.find("calibration ns");
+    double scale = then != baseline.end() && !update ? calibration / then->second : 1;
+    printf("calibration %.2f ms, %.2fx the baseline machine\n", calibration / 1e6, scale);
+    map<string, double> results;
+    int regressions = 0;
+    printf("%-28s %-9s %12s %12s %8s\n", "scenario", "metric", "ns", "expected", "change");
+    for (const Scenario& scenario : scenarios(replayDir)) {
+        if (!only.empty() && scenario.name.find(only) == string::npos) continue;
+        Timing best = measure(scenario, runs);
+        // a slow result on a busy machine is measured again before it counts
+        for (int retry = 0; retry < 2 && !update && slower(scenario.name, best, baseline, scale); retry++) {
+            Timing again = measure(scenario, runs);
+            best.tickNs = min(best.tickNs, again.tickNs);
+            best.frameNs = min(best.frameNs, again.frameNs);
+        }
+        if (best.tickNs <= 0) {
+            fprintf(stderr, "%s: could not run\n", scenario.name.c_str());
+            regressions++;
+            continue;
+        }
+        double values[] = { best.tickNs, best.frameNs };
+        for (int m = 0; m < (rendering ? 2 : 1); m++) {
+            string key = scenario.name + " " + metrics[m];
+            results[key] = values[m];
+            map<string, double>::const_iterator base = baseline.find(key);
+            if (base == baseline.end()) {
+                printf("%-28s %-9s %12.0f %12s %8s\n", scenario.name.c_str(), metrics[m], values[m], "-", "new");
+                continue;
+            }
+            double expected = base->second * scale;
+            double change = (values[m] / expected - 1) * 100;
+            bool regressed = change > thresholds[m];
+            if (regressed) regressions++;
+            printf("%-28s %-9s %12.0f %12.0f %+7.1f%%%s\n", scenario.name.c_str(), metrics[m], values[m], expected,
+                   change, regressed ? "  REGRESSION" : "");
+        }
+    }
+    if (rendering) offscreenClose();
+    if (update) {
+        if (!writeBaseline(baselinePath, results, calibration)) {
+            fprintf(stderr, "could not write %s\n", baselinePath.c_str());
+            return 1;
+        }
+        printf("baselines written to %s\n", baselinePath.c_str());
+        return 0;
+    }
+    if (regressions > 0) {
+        printf("FAIL: %d measurement(s) slower than %s allows (ticks %.0f%%, frames %.0f%%)\n", regressions,
+               baselinePath.c_str(), thresholds[0], thresholds[1]);
+        return 1;
+    }
+    printf("PASS: within %.0f%% of %s for ticks, %.0f%% for frames\n", thresholds[0], baselinePath.c_str(), thresholds[1]);
+    return 0;
+}
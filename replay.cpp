@@ -0,0 +1,329 @@
+/*
+ * replay.cpp
+ *
+ */
+#include "replay.h"
+#include "log.h"
+#include <algorithm>
+#include <cstring>
+
+static const int HEADER_SIZE = 16;
+static const int CHUNK_HEADER_SIZE = 16;
+static const int TRAILER_SIZE = 12;
+
+enum DeltaFlags {
+    DELTA_FUEL = 1,         // fuel changed
+    DELTA_SCORE = 2,        // score or money changed
+    DELTA_ITEMS = 4,        // pickup items, destination or cargo changed
+};
+
+static void putLE16(vector<unsigned char>& out, unsigned int v) {
+    out.push_back(v & 0xFF);
+    out.push_back((v >> 8) & 0xFF);
+}
+
+static void putLE32(vector<unsigned char>& out, unsigned int v) {
+    for (int i = 0; i < 4; i++) out.push_back((v >> (8 * i)) & 0xFF);
+}
+
+static unsigned int getLE16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int getLE32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// Signed values as zigzag varints: small magnitudes of either sign take one byte
+static void putVarint(vector<unsigned char>& out, int v) {
+    unsigned int z = ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+    while (z >= 0x80) {
+        out.push_back((z & 0x7F) | 0x80);
+        z >>= 7;
+    }
+    out.push_back(z);
+}
+
+static int getVarint(const unsigned char*& p, const unsigned char* end) {
+    unsigned int z = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7) {
+        unsigned char b = *p++;
+        z |= (unsigned int)(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+    }
+    return (int)(z >> 1) ^ -(int)(z & 1);
+}
+
+static void putItems(vector<unsigned char>& out, const ReplayFrame& f) {
+    out.push_back((f.carrying ? 1 : 0) | (f.destActive ? 2 : 0));
+    putLE16(out, (unsigned short)f.destX);
+    putLE16(out, (unsigned short)f.destY);
+    out.push_back((unsigned char)f.numItems);
+    for (int i = 0; i < f.numItems; i++) {
+        putLE16(out, (unsigned short)f.itemX[i]);
+        putLE16(out, (unsigned short)f.itemY[i]);
+        out.push_back(f.itemActive[i] ? 1 : 0);
+    }
+}
+
+static bool getItems(const unsigned char*& p, const unsigned char* end, ReplayFrame& f) {
+    if (end - p < 6) return false;
+    f.carrying = p[0] & 1;
+    f.destActive = (p[0] & 2) != 0;
+    f.destX = (short)getLE16(p + 1);
+    f.destY = (short)getLE16(p + 3);
+    f.numItems = min((int)p[5], REPLAY_MAX_ITEMS);
+    p += 6;
+    if (end - p < 5 * f.numItems) return false;
+    for (int i = 0; i < f.numItems; i++, p += 5) {
+        f.itemX[i] = (short)getLE16(p);
+        f.itemY[i] = (short)getLE16(p + 2);
+        f.itemActive[i] = p[4] != 0;
+    }
+    return true;
+}
+
+static bool sameItems(const ReplayFrame& a, const ReplayFrame& b) {
+    if (a.carrying != b.carrying || a.destActive != b.destActive || a.destX != b.destX ||
+        a.destY != b.destY || a.numItems != b.numItems) return false;
+    for (int i = 0; i < a.numItems; i++) {
+        if (a.itemX[i] != b.itemX[i] || a.itemY[i] != b.itemY[i] || a.itemActive[i] != b.itemActive[i]) return false;
+    }
+    return true;
+}
+
+static void putKeyframe(vector<unsigned char>& out, const ReplayFrame& f) {
+    out.push_back((unsigned char)f.numCars);
+    for (int i = 0; i < f.numCars; i++) {
+        putLE16(out, (unsigned short)f.carX[i]);
+        putLE16(out, (unsigned short)f.carY[i]);
+    }
+    putLE32(out, (unsigned int)f.fuelMilli);
+    putLE32(out, (unsigned int)f.money);
+    putLE32(out, (unsigned int)f.score);
+    for (int i = 0; i < REPLAY_STATIONS; i++) {
+        putLE16(out, (unsigned short)f.stationX[i]);
+        putLE16(out, (unsigned short)f.stationY[i]);
+    }
+    putItems(out, f);
+}
+
+static bool getKeyframe(const unsigned char*& p, const unsigned char* end, ReplayFrame& f) {
+    if (p >= end) return false;
+    f.numCars = min((int)*p++, REPLAY_MAX_CARS);
+    if (end - p < 4 * f.numCars + 12 + 4 * REPLAY_STATIONS) return false;
+    for (int i = 0; i < f.numCars; i++, p += 4) {
+        f.carX[i] = (short)getLE16(p);
+        f.carY[i] = (short)getLE16(p + 2);
+    }
+    f.fuelMilli = (int)getLE32(p);
+    f.money = (int)getLE32(p + 4);
+    f.score = (int)getLE32(p + 8);
+    p += 12;
+    for (int i = 0; i < REPLAY_STATIONS; i++, p += 4) {
+        f.stationX[i] = (short)getLE16(p);
+        f.stationY[i] = (short)getLE16(p + 2);
+    }
+    return getItems(p, end, f);
+}
+
+bool ReplayRecorder::open(const string& path, ReplayRole role, int tickMs) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        LOG_WARN("Could not create replay file %s", path.c_str());
+        return false;
+    }
+    vector<unsigned char> header;
+    header.insert(header.end(), "RHRP", "RHRP" + 4);
+    putLE16(header, REPLAY_VERSION);
+    putLE16(header, tickMs);
+    header.push_back((unsigned char)role);
+    header.resize(HEADER_SIZE, 0);
+    fwrite(header.data(), 1, header.size(), file);
+    offset = HEADER_SIZE;
+    chunk.clear();
+    chunkTicks = 0;
+    index.clear();
+    ticks = 0;
+    return true;
+}
+
+void ReplayRecorder::writeChunk() {
+    if (chunkTicks == 0) return;
+    vector<unsigned char> header;
+    header.insert(header.end(), "KEYF", "KEYF" + 4);
+    putLE32(header, chunkTick);
+    putLE32(header, chunkTicks);
+    putLE32(header, (unsigned int)chunk.size());
+    fwrite(header.data(), 1, header.size(), file);
+    fwrite(chunk.data(), 1, chunk.size(), file);
+    index.push_back(make_pair(chunkTick, offset));
+    offset += CHUNK_HEADER_SIZE + chunk.size();
+    chunk.clear();
+    chunkTicks = 0;
+}
+
+void ReplayRecorder::record(ReplayFrame& frame) {
+    if (!file) return;
+    frame.tick = ticks++;
+    if (chunkTicks == REPLAY_KEYFRAME_TICKS || chunkTicks == 0 || frame.numCars != last.numCars) {
+        writeChunk();
+        chunkTick = frame.tick;
+        putKeyframe(chunk, frame);
+        for (int i = 0; i < REPLAY_MAX_CARS; i++) lastDX[i] = lastDY[i] = 0;
+    } else {
+        // flags and masks go in front of the moves once they are known
+        size_t at = chunk.size();
+        chunk.resize(at + 3);
+        unsigned char flags = 0, moved = 0, repeated = 0;
+        for (int i = 0; i < frame.numCars; i++) {
+            short dx = frame.carX[i] - last.carX[i], dy = frame.carY[i] - last.carY[i];
+            if (dx || dy) {
+                moved |= 1 << i;
+                if (dx == lastDX[i] && dy == lastDY[i]) {
+                    repeated |= 1 << i;
+                } else {
+                    putVarint(chunk, dx);
+                    putVarint(chunk, dy);
+                }
+            }
+            lastDX[i] = dx;
+            lastDY[i] = dy;
+        }
+        if (frame.fuelMilli != last.fuelMilli) flags |= DELTA_FUEL;
+        if (frame.score != last.score || frame.money != last.money) flags |= DELTA_SCORE;
+        if (!sameItems(frame, last)) flags |= DELTA_ITEMS;
+        chunk[at] = flags;
+        chunk[at + 1] = moved;
+        chunk[at + 2] = repeated;
+        if (flags & DELTA_FUEL) putVarint(chunk, frame.fuelMilli - last.fuelMilli);
+        if (flags & DELTA_SCORE) {
+            putVarint(chunk, frame.score - last.score);
+            putVarint(chunk, frame.money - last.money);
+        }
+        if (flags & DELTA_ITEMS) putItems(chunk, frame);
+    }
+    chunkTicks++;
+    last = frame;
+}
+
+void ReplayRecorder::close() {
+    if (!file) return;
+    writeChunk();
+    vector<unsigned char> trailer;
+    for (auto& entry : index) {
+        putLE32(trailer, entry.first);
+        putLE32(trailer, entry.second);
+    }
+    putLE32(trailer, (unsigned int)index.size());
+    putLE32(trailer, offset);
+    trailer.insert(trailer.end(), "RPIX", "RPIX" + 4);
+    fwrite(trailer.data(), 1, trailer.size(), file);
+    fclose(file);
+    file = nullptr;
+    LOG_INFO("Replay closed: %u ticks in %u bytes", ticks, offset + (unsigned int)trailer.size());
+}
+
+bool ReplayReader::chunkFits(size_t pos, size_t end) const {
+    return pos + CHUNK_HEADER_SIZE <= end && memcmp(&data[pos], "KEYF", 4) == 0 &&
+           getLE32(&data[pos + 12]) <= end - pos - CHUNK_HEADER_SIZE;
+}
+
+bool ReplayReader::open(const string& path) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) return false;
+    data.clear();
+    unsigned char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0) data.insert(data.end(), buffer, buffer + n);
+    fclose(in);
+    if (data.size() < (size_t)HEADER_SIZE || memcmp(&data[0], "RHRP", 4) != 0) return false;
+    if ((int)getLE16(&data[4]) != REPLAY_VERSION) {
+        LOG_WARN("%s: unsupported replay version %u", path.c_str(), getLE16(&data[4]));
+        return false;
+    }
+    tickMs = getLE16(&data[6]);
+    if (tickMs == 0) {
+        LOG_WARN("%s: replay has a tick length of 0 ms", path.c_str());
+        return false;
+    }
+    role = (ReplayRole)data[8];
+    index.clear();
+    totalTicks = 0;
+
+    size_t size = data.size();
+    const unsigned char* trailer = &data[0] + size - TRAILER_SIZE;
+    bool indexed = false;
+    if (size >= (size_t)HEADER_SIZE + TRAILER_SIZE && memcmp(trailer + 8, "RPIX", 4) == 0 &&
+        getLE32(trailer + 4) + 8ULL * getLE32(trailer) + TRAILER_SIZE == size) {
+        // every entry must name a whole chunk before the index, for its tick, in tick order
+        unsigned int chunks = getLE32(trailer), indexAt = getLE32(trailer + 4);
+        indexed = indexAt >= (unsigned int)HEADER_SIZE;
+        const unsigned char* p = &data[indexAt];
+        for (unsigned int i = 0; i < chunks && indexed; i++, p += 8) {
+            unsigned int tick = getLE32(p), pos = getLE32(p + 4);
+            indexed = chunkFits(pos, indexAt) && getLE32(&data[pos + 4]) == tick &&
+                      (index.empty() || tick > index.back().first);
+            index.push_back(make_pair(tick, pos));
+        }
+        if (!indexed) {
+            LOG_WARN("%s has a corrupt index, rebuilding it", path.c_str());
+            index.clear();
+        }
+    } else {
+        LOG_INFO("%s has no index, rebuilding it", path.c_str());
+    }
+    if (!indexed) {
+        // walk the chunk headers, dropping a torn last chunk
+        size_t pos = HEADER_SIZE;
+        while (chunkFits(pos, size)) {
+            index.push_back(make_pair(getLE32(&data[pos + 4]), (unsigned int)pos));
+            pos += CHUNK_HEADER_SIZE + getLE32(&data[pos + 12]);
+        }
+    }
+    if (!index.empty()) {
+        const unsigned char* lastChunk = &data[index.back().second];
+        totalTicks = getLE32(lastChunk + 4) + getLE32(lastChunk + 8);
+    }
+    return true;
+}
+
+bool ReplayReader::seek(unsigned int tick, ReplayFrame& frame) const {
+    if (index.empty()) return false;
+    if (tick >= totalTicks) tick = totalTicks - 1;
+    // last chunk starting at or before `tick`
+    auto it = upper_bound(index.begin(), index.end(), make_pair(tick, 0xFFFFFFFFu));
+    if (it != index.begin()) --it;
+    if (it->second + (size_t)CHUNK_HEADER_SIZE > data.size()) return false;
+    const unsigned char* header = &data[it->second];
+    const unsigned char* p = header + CHUNK_HEADER_SIZE;
+    if (getLE32(header + 12) > data.size() - it->second - CHUNK_HEADER_SIZE) return false;
+    const unsigned char* end = p + getLE32(header + 12);
+    if (!getKeyframe(p, end, frame)) return false;
+    frame.tick = getLE32(header + 4);
+    short lastDX[REPLAY_MAX_CARS] = {0}, lastDY[REPLAY_MAX_CARS] = {0};
+    while (frame.tick < tick) {
+        if (end - p < 3) return false;
+        unsigned char flags = p[0], moved = p[1], repeated = p[2];
+        p += 3;
+        for (int i = 0; i < frame.numCars; i++) {
+            if (!(moved & (1 << i))) {
+                lastDX[i] = lastDY[i] = 0;
+            } else if (!(repeated & (1 << i))) {
+                lastDX[i] = (short)getVarint(p, end);
+                lastDY[i] = (short)getVarint(p, end);
+            }
+            frame.carX[i] += lastDX[i];
+            frame.carY[i] += lastDY[i];
+        }
+        if (flags & DELTA_FUEL) frame.fuelMilli += getVarint(p, end);
+        if (flags & DELTA_SCORE) {
+            frame.score += getVarint(p, end);
+            frame.money += getVarint(p, end);
+        }
+        if ((flags & DELTA_ITEMS) && !getItems(p, end, frame)) return false;
+        frame.tick++;
+    }
+    return true;
+}
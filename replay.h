@@ -0,0 +1,96 @@
+/*
+ * replay.h
+ *
+ * State-based replays. A keyframe holding the whole world is written every
+ * REPLAY_KEYFRAME_TICKS ticks; the ticks in between only store what changed,
+ * mostly vehicle moves, and a car that keeps going the same way costs one
+ * bit per tick. An index of keyframe offsets at the end of the file lets a
+ * viewer jump to any tick by decoding one keyframe and at most
+ * REPLAY_KEYFRAME_TICKS - 1 deltas.
+ */
+
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+const int REPLAY_VERSION = 1;
+const int REPLAY_KEYFRAME_TICKS = 100;
+const int REPLAY_MAX_CARS = 8;      // the player is car 0
+const int REPLAY_MAX_ITEMS = 4;
+const int REPLAY_STATIONS = 3;
+
+enum ReplayRole { REPLAY_TAXI, REPLAY_DELIVERY };
+
+// Everything needed to draw one tick
+struct ReplayFrame {
+    unsigned int tick;
+    int numCars;
+    short carX[REPLAY_MAX_CARS], carY[REPLAY_MAX_CARS];
+    int fuelMilli;                  // fuel * 1000
+    int money;
+    int score;
+    bool carrying;                  // player has a passenger/package on board
+    bool destActive;
+    short destX, destY;
+    int numItems;
+    short itemX[REPLAY_MAX_ITEMS], itemY[REPLAY_MAX_ITEMS];
+    bool itemActive[REPLAY_MAX_ITEMS];
+    short stationX[REPLAY_STATIONS], stationY[REPLAY_STATIONS];
+};
+
+// On-disk layout, all integers little-endian:
+//   header  "RHRP" | u16 version | u16 tick length in ms | u8 role | 7 bytes reserved
+//   chunk   "KEYF" | u32 first tick | u32 ticks | u32 payload bytes | keyframe | deltas
+//   delta   u8 flags | u8 moved | u8 repeated | car moves | [fuel] | [score, money] | [items]
+//   index   ("u32 tick | u32 offset" per chunk) | u32 chunks | u32 index offset | "RPIX"
+// Moves and changes are zigzag varints. A file without the index (the game
+// did not exit cleanly) is indexed by walking the chunk headers.
+class ReplayRecorder {
+private:
+    FILE* file;
+    vector<unsigned char> chunk;    // current chunk, written when the next keyframe starts
+    unsigned int chunkTick, chunkTicks;
+    vector<pair<unsigned int, unsigned int> > index;   // {first tick, file offset}
+    unsigned int offset;
+    ReplayFrame last;
+    short lastDX[REPLAY_MAX_CARS], lastDY[REPLAY_MAX_CARS];
+    unsigned int ticks;
+
+    void writeChunk();
+public:
+    ReplayRecorder() : file(nullptr), chunkTick(0), chunkTicks(0), offset(0), ticks(0) {}
+    ~ReplayRecorder() { close(); }
+    bool open(const string& path, ReplayRole role, int tickMs);
+    bool isOpen() const { return file != nullptr; }
+    // Once per simulation tick; frame.tick is filled in here.
+    void record(ReplayFrame& frame);
+    // Writes the last chunk and the index.
+    void close();
+};
+
+class ReplayReader {
+private:
+    vector<unsigned char> data;
+    vector<pair<unsigned int, unsigned int> > index;
+    unsigned int totalTicks;
+    int tickMs;
+    ReplayRole role;
+    // Whether a whole chunk starts at `pos` and ends by `end`
+    bool chunkFits(size_t pos, size_t end) const;
+public:
+    ReplayReader() : totalTicks(0), tickMs(100), role(REPLAY_TAXI) {}
+    // False if the file is missing or is not a replay. A corrupt index is
+    // ignored and rebuilt from the chunks.
+    bool open(const string& path);
+    unsigned int tickCount() const { return totalTicks; }
+    int getTickMs() const { return tickMs; }
+    ReplayRole getRole() const { return role; }
+    // Decodes the state at `tick` (clamped to the recording).
+    bool seek(unsigned int tick, ReplayFrame& frame) const;
+};
+
+#endif /* REPLAY_H_ */
@@ -0,0 +1,338 @@
+/*
+ * scored.cpp
+ *
+ * Score aggregation daemon. Game instances on this host submit scores over
+ * a Unix domain socket; submissions are collected into batches and applied
+ * to one shared HighScoreStore, whose background writer turns each batch
+ * into a single append. A submission is answered with OK only once its
+ * batch is synced to disk, and queries always see every submission
+ * received so far.
+ *
+ * The store keeps the best ENTRIES scores and compacts the file whenever
+ * it holds twice that many records.
+ *
+ *   scored [-f FILE] [-s SOCKET] [-n ENTRIES]
+ */
+#include "highscores.h"
+#include "log.h"
+#include "scoreservice.h"
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <unordered_set>
+
+static const int MAX_CLIENTS = 1024;
+static const size_t MAX_BATCH = 4096;        // apply at this many pending submissions...
+static const int BATCH_INTERVAL_MS = 20;     // ...or this long after the first one
+static const size_t MAX_LINE = 256;
+static const int DEFAULT_CAPACITY = 1000000;
+static const size_t REMEMBERED_IDS = 100000;  // submission ids kept to spot a resent submission
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int) {
+    stopRequested = 1;
+}
+
+struct Client {
+    int fd;
+    string input;
+    string output;
+};
+
+class ScoreServer {
+private:
+    HighScoreStore& store;
+    vector<HighScore> pending;
+    vector<int> submitters;     // per pending submission, the client fd owed an OK once it is on disk
+    deque<pair<unsigned long long, int> > unwritten;   // write ticket of an applied submission, and its client fd
+    unordered_set<string> seenIds;
+    deque<string> seenOrder;    // oldest first, so the set stays bounded
+    chrono::steady_clock::time_point firstPending;
+    long long received, applied;
+public:
+    explicit ScoreServer(HighScoreStore& s) : store(s), received(0), applied(0) {}
+
+    void submit(int fd, const string& id, int score, const char* name) {
+        if (submitters.empty()) firstPending = chrono::steady_clock::now();
+        submitters.push_back(fd);
+        // a resent submission is only acknowledged, once what came before it is on disk
+        if (!seenIds.insert(id).second) return;
+        seenOrder.push_back(id);
+        if (seenOrder.size() > REMEMBERED_IDS) {
+            seenIds.erase(seenOrder.front());
+            seenOrder.pop_front();
+        }
+        HighScore hs;
+        memset(hs.name, 0, sizeof(hs.name));
+        strncpy(hs.name, name, 19);
+        hs.score = score;
+        pending.push_back(hs);
+        received++;
+        if (pending.size() >= MAX_BATCH) applyBatch();
+    }
+
+    void applyBatch() {
+        if (submitters.empty()) return;
+        if (!pending.empty()) {
+            applied += store.addBatch(pending.data(), (int)pending.size());
+            LOG_DEBUG("Applied batch of %d submissions", (int)pending.size());
+            pending.clear();
+        }
+        // a batch that did not make the cut queues nothing, and waits only for earlier writes
+        unsigned long long ticket = store.queuedThrough();
+        for (int fd : submitters) unwritten.push_back(make_pair(ticket, fd));
+        submitters.clear();
+    }
+
+    // Client fds to send an OK to, one per submission that reached the disk since the last call
+    void takeAcknowledged(vector<int>& fds) {
+        fds.clear();
+        if (unwritten.empty()) return;
+        unsigned long long written = store.writtenThrough();
+        while (!unwritten.empty() && unwritten.front().first <= written) {
+            fds.push_back(unwritten.front().second);
+            unwritten.pop_front();
+        }
+    }
+
+    // A closed client is owed nothing, and its fd may be reused
+    void forget(int fd) {
+        for (size_t i = 0; i < submitters.size(); i++) {
+            if (submitters[i] == fd) submitters[i] = -1;
+        }
+        for (auto& entry : unwritten) {
+            if (entry.second == fd) entry.second = -1;
+        }
+    }
+
+    // Milliseconds until the pending batch is due, or -1 if nothing is pending
+    int msUntilDue() const {
+        if (submitters.empty()) return -1;
+        int elapsed = (int)chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - firstPending).count();
+        return elapsed >= BATCH_INTERVAL_MS ? 0 : BATCH_INTERVAL_MS - elapsed;
+    }
+
+    // Handles one request line from client `fd`, appending any reply to
+    // `out`; a submission is answered later, once its batch is on disk
+    void handle(int fd, const string& line, string& out) {
+        int a = 0, b = 0, consumed = 0;
+        char id[MAX_SUBMISSION_ID + 1];
+        if (line.compare(0, 7, "SUBMIT ") == 0 &&
+            sscanf(line.c_str() + 7, "%32s %d %n", id, &a, &consumed) == 2) {
+            submit(fd, id, a, line.c_str() + 7 + consumed);
+        } else if (sscanf(line.c_str(), "PAGE %d %d", &a, &b) == 2) {
+            applyBatch();
+            out += "COUNT " + to_string(store.count()) + "\n";
+            for (const HighScore& hs : store.page(a, b)) {
+                out += to_string(hs.score) + " " + hs.name + "\n";
+            }
+            out += "END\n";
+        } else if (line.compare(0, 5, "RANK ") == 0) {
+            applyBatch();
+            HighScore best;
+            int rank;
+            if (store.bestOf(line.substr(5), best, rank)) {
+                out += "RANK " + to_string(rank) + " " + to_string(best.score) + " " + to_string(store.count()) + "\n";
+            } else {
+                out += "NONE\n";
+            }
+        } else if (!line.empty()) {
+            out += "ERROR unknown request\n";
+        }
+    }
+
+    long long receivedCount() const { return received; }
+    long long appliedCount() const { return applied; }
+};
+
+static int listenOn(const string& path) {
+    sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        LOG_ERROR("Socket path too long: %s", path.c_str());
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    // a socket left behind by a crash is replaced; one that answers belongs to a running service
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+        LOG_ERROR("Another score service is already listening on %s", path.c_str());
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 128) != 0) {
+        LOG_ERROR("Could not listen on %s: %s", path.c_str(), strerror(errno));
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+// Reads what is available; returns false once the client is gone
+static bool readClient(Client& c, ScoreServer& server) {
+    char buf[16384];
+    while (true) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n == 0) return false;
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        c.input.append(buf, n);
+        size_t start = 0, nl;
+        while ((nl = c.input.find('\n', start)) != string::npos) {
+            server.handle(c.fd, c.input.substr(start, nl - start), c.output);
+            start = nl + 1;
+        }
+        c.input.erase(0, start);
+        if (c.input.size() > MAX_LINE) return false;
+    }
+}
+
+static bool writeClient(Client& c) {
+    while (!c.output.empty()) {
+        ssize_t n = send(c.fd, c.output.data(), c.output.size(), MSG_NOSIGNAL);
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        c.output.erase(0, n);
+    }
+    return true;
+}
+
+// Queues an OK for each acknowledged submission whose client is still connected
+static void queueAcknowledgements(ScoreServer& server, vector<Client>& clients, vector<int>& acknowledged) {
+    server.takeAcknowledged(acknowledged);
+    if (acknowledged.empty()) return;
+    // fds are small numbers, so index the clients by them
+    vector<Client*> byFd;
+    for (Client& c : clients) {
+        if (c.fd >= (int)byFd.size()) byFd.resize(c.fd + 1, nullptr);
+        byFd[c.fd] = &c;
+    }
+    for (int fd : acknowledged) {
+        if (fd >= 0 && fd < (int)byFd.size() && byFd[fd]) byFd[fd]->output += "OK\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    string file = "highscores.txt";
+    string socketPath = DEFAULT_SCORE_SOCKET;
+    int capacity = DEFAULT_CAPACITY;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-f") == 0) file = argv[i + 1];
+        else if (strcmp(argv[i], "-s") == 0) socketPath = argv[i + 1];
+        else if (strcmp(argv[i], "-n") == 0) {
+            char* end;
+            long n = strtol(argv[i + 1], &end, 10);
+            if (end == argv[i + 1] || *end || n < 1 || n > INT_MAX) {
+                fprintf(stderr, "scored: -n needs a positive number of entries\n");
+                return 2;
+            }
+            capacity = (int)n;
+        }
+    }
+    logStart();
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+
+    // the writer thread wakes the poll loop whenever a batch reaches the disk
+    int wake[2];
+    if (pipe(wake) != 0) {
+        LOG_ERROR("Could not create a pipe: %s", strerror(errno));
+        logShutdown();
+        return 1;
+    }
+    fcntl(wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake[1], F_SETFL, O_NONBLOCK);
+    HighScoreStore store(file, capacity);
+    store.onWritten([&wake]() {
+        char byte = 0;
+        (void)!write(wake[1], &byte, 1);
+    });
+    store.load();
+    LOG_INFO("Serving %d high scores from %s on %s", store.count(), file.c_str(), socketPath.c_str());
+    int listener = listenOn(socketPath);
+    if (listener < 0) {
+        logShutdown();
+        return 1;
+    }
+    ScoreServer server(store);
+    vector<Client> clients;
+    vector<pollfd> fds;
+    vector<int> acknowledged;
+
+    while (!stopRequested) {
+        fds.clear();
+        fds.push_back(pollfd{ listener, POLLIN, 0 });
+        fds.push_back(pollfd{ wake[0], POLLIN, 0 });
+        for (const Client& c : clients) {
+            fds.push_back(pollfd{ c.fd, (short)(POLLIN | (c.output.empty() ? 0 : POLLOUT)), 0 });
+        }
+        int ready = poll(fds.data(), fds.size(), server.msUntilDue());
+        if (ready < 0 && errno != EINTR) {
+            LOG_ERROR("poll failed: %s", strerror(errno));
+            break;
+        }
+        if (ready > 0) {
+            // fds[i + 2] belongs to clients[i]; walk backwards so removal keeps them aligned
+            for (int i = (int)clients.size() - 1; i >= 0; i--) {
+                short revents = fds[i + 2].revents;
+                bool alive = true;
+                if (revents & (POLLIN | POLLHUP | POLLERR)) alive = readClient(clients[i], server);
+                if (alive) alive = writeClient(clients[i]);
+                if (!alive) {
+                    server.forget(clients[i].fd);
+                    close(clients[i].fd);
+                    clients.erase(clients.begin() + i);
+                }
+            }
+            if (fds[0].revents & POLLIN) {
+                int fd;
+                while ((fd = accept(listener, nullptr, nullptr)) >= 0) {
+                    if ((int)clients.size() >= MAX_CLIENTS) {
+                        close(fd);
+                        continue;
+                    }
+                    fcntl(fd, F_SETFL, O_NONBLOCK);
+                    clients.push_back(Client{ fd, "", "" });
+                }
+            }
+            if (fds[1].revents & POLLIN) {
+                char drain[256];
+                while (read(wake[0], drain, sizeof(drain)) > 0) {}
+            }
+        }
+        if (server.msUntilDue() == 0) server.applyBatch();
+        queueAcknowledgements(server, clients, acknowledged);
+    }
+
+    // what was received is saved, and acknowledged where the client still listens
+    server.applyBatch();
+    store.flush();
+    queueAcknowledgements(server, clients, acknowledged);
+    for (Client& c : clients) {
+        writeClient(c);
+        close(c.fd);
+    }
+    close(listener);
+    unlink(socketPath.c_str());
+    close(wake[0]);
+    close(wake[1]);
+    LOG_INFO("Stopped after %lld submissions, %lld kept", server.receivedCount(), server.appliedCount());
+    logShutdown();
+    return 0;
+}
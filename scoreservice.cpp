@@ -0,0 +1,98 @@
+/*
+ * scoreservice.cpp
+ *
+ */
+#include "scoreservice.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+int scoreServiceConnect(const string& socketPath) {
+    sockaddr_un addr;
+    if (socketPath.empty() || socketPath.size() >= sizeof(addr.sun_path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath.c_str());
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    // a wedged service must not hang the game
+    timeval timeout = { 0, 500 * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+static bool sendAll(int fd, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Reads one line (without the newline) from an unbuffered socket
+static bool readLine(int fd, string& buffer, string& line) {
+    while (true) {
+        size_t nl = buffer.find('\n');
+        if (nl != string::npos) {
+            line = buffer.substr(0, nl);
+            buffer.erase(0, nl + 1);
+            return true;
+        }
+        char chunk[4096];
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n <= 0) return false;
+        buffer.append(chunk, n);
+    }
+}
+
+string scoreSubmissionId() {
+    random_device random;
+    char id[17];
+    snprintf(id, sizeof(id), "%08x%08x", (unsigned int)random(), (unsigned int)random());
+    return id;
+}
+
+bool scoreServiceSubmit(const string& socketPath, const string& id, const string& name, int score) {
+    string request = "SUBMIT " + id + " " + to_string(score) + " " + name.substr(0, 19) + "\n";
+    // the same id makes a resend safe when the first OK was lost or late
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fd = scoreServiceConnect(socketPath);
+        if (fd < 0) return false;
+        string buffer, line;
+        bool ok = sendAll(fd, request) && readLine(fd, buffer, line) && line == "OK";
+        close(fd);
+        if (ok) return true;
+    }
+    return false;
+}
+
+bool scoreServicePage(const string& socketPath, int offset, int n, vector<HighScore>& page, int& total) {
+    int fd = scoreServiceConnect(socketPath);
+    if (fd < 0) return false;
+    page.clear();
+    string buffer, line;
+    bool ok = sendAll(fd, "PAGE " + to_string(offset) + " " + to_string(n) + "\n") &&
+              readLine(fd, buffer, line) && sscanf(line.c_str(), "COUNT %d", &total) == 1;
+    while (ok && (ok = readLine(fd, buffer, line)) && line != "END") {
+        HighScore hs;
+        int consumed = 0;
+        memset(hs.name, 0, sizeof(hs.name));
+        if (sscanf(line.c_str(), "%d %n", &hs.score, &consumed) != 1) continue;
+        strncpy(hs.name, line.c_str() + consumed, 19);
+        page.push_back(hs);
+    }
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,39 @@
+/*
+ * scoreservice.h
+ *
+ * Client side of the score aggregation service (see scored.cpp). Game
+ * instances on one host submit scores to a single daemon over a Unix
+ * domain socket instead of all rewriting the same file.
+ *
+ * Protocol, one request per line:
+ *   SUBMIT <id> <score> <name> "OK" once its batch is synced to disk
+ * The id is chosen by the client, at most 32 characters without spaces.
+ * A submission resent with the same id is acknowledged but not counted
+ * again, as long as the service still remembers the id.
+ *   PAGE <offset> <count>      "COUNT <total>", then "<score> <name>" lines, then "END"
+ *   RANK <name>                "RANK <rank> <score> <total>" or "NONE"
+ */
+
+#ifndef SCORESERVICE_H_
+#define SCORESERVICE_H_
+
+#include "highscores.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+#define DEFAULT_SCORE_SOCKET "/tmp/rushhour-scores.sock"
+const int MAX_SUBMISSION_ID = 32;
+
+// Connects to the service; returns -1 if it is not running.
+int scoreServiceConnect(const string& socketPath);
+// A new random submission id.
+string scoreSubmissionId();
+// Sends one submission and waits until the service has saved it, resending
+// it once if there is no answer. False if the service is unreachable or
+// does not confirm it in time.
+bool scoreServiceSubmit(const string& socketPath, const string& id, const string& name, int score);
+// Fetches one page of the shared leaderboard.
+bool scoreServicePage(const string& socketPath, int offset, int n, vector<HighScore>& page, int& total);
+
+#endif /* SCORESERVICE_H_ */
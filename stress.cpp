@@ -0,0 +1,70 @@
+/*
+ * stress.cpp
+ *
+ * Traffic capacity test. Fills a generated city with tens of thousands of
+ * cars (the smallest city of the game's layout with four road cells for
+ * each, so they keep moving, unless --city says otherwise), runs them as
+ * a TrafficBatch and reports ticks per second, the cost per car, the
+ * memory each car takes with its share of the lanes, and how many cars
+ * were waiting in the last tick. A city too small for every car gets one
+ * per road cell. The
+ * checksum of the final positions depends only on the car count, city,
+ * ticks and seed, so runs with different --threads must print the same one.
+ *
+ *   stress [--cars=N[,N...]] [--ticks=N] [--threads=N] [--city=CELLS] [--seed=N]
+ */
+#include "traffic.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+static double nowNs() {
+    return (double)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv) {
+    vector<int> carCounts = { 10000, 30000, 100000 };
+    int ticks = 1000, threads = -1, city = 0;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--cars=", 7) == 0) {
+            carCounts.clear();
+            stringstream list(arg + 7);
+            string count;
+            while (getline(list, count, ',')) {
+                if (atoi(count.c_str()) > 0) carCounts.push_back(atoi(count.c_str()));
+            }
+        }
+        else if (strncmp(arg, "--ticks=", 8) == 0) ticks = max(1, atoi(arg + 8));
+        else if (strncmp(arg, "--threads=", 10) == 0) threads = atoi(arg + 10);
+        else if (strncmp(arg, "--city=", 7) == 0) city = atoi(arg + 7);
+        else if (strncmp(arg, "--seed=", 7) == 0) seed = strtoul(arg + 7, nullptr, 10);
+        else {
+            fprintf(stderr, "usage: stress [--cars=N[,N...]] [--ticks=N] [--threads=N] [--city=CELLS] [--seed=N]\n");
+            return 2;
+        }
+    }
+    // --threads counts the thread that waits, as threadCount() does
+    JobSystem jobs(threads > 0 ? threads - 1 : -1);
+    printf("%d ticks on %d thread(s)\n", ticks, jobs.threadCount());
+    printf("%8s %11s %12s %12s %8s %8s %18s\n", "cars", "city", "ticks/s", "ns/car-tick", "B/car", "waiting", "checksum");
+    for (size_t c = 0; c < carCounts.size(); c++) {
+        int cars = carCounts[c];
+        int cells = city > 0 ? min(city, MAX_CITY_CELLS) : TrafficBatch::citySizeFor(cars * 4);
+        TrafficBatch batch(cells, cars, seed);
+        cars = batch.size();
+        for (int t = 0; t < 10; t++) batch.tick(&jobs);     // warm up
+        double start = nowNs();
+        for (int t = 10; t < ticks; t++) batch.tick(&jobs);
+        double perTick = (nowNs() - start) / max(1, ticks - 10);
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", cells, cells);
+        printf("%8d %11s %12.0f %12.2f %8zu %7.1f%% %016llx\n", cars, size, 1e9 / perTick, perTick / cars, batch.bytesPerCar(),
+               100.0 * batch.waiting() / max(cars, 1), (unsigned long long)batch.checksum());
+    }
+    return 0;
+}
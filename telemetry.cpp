@@ -0,0 +1,217 @@
+/*
+ * telemetry.cpp
+ *
+ */
+#include "telemetry.h"
+#include "log.h"
+#include <cstring>
+#include <ctime>
+
+TelemetryRecorder telemetry;
+
+static const int HEADER_SIZE = 16;
+static const int BLOCK_HEADER_SIZE = 16;
+
+static void putLE16(unsigned char* p, unsigned int v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static void putLE32(unsigned char* p, unsigned int v) {
+    for (int i = 0; i < 4; i++) p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static unsigned int getLE16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int getLE32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned int floatBits(float f) {
+    unsigned int bits;
+    memcpy(&bits, &f, 4);
+    return bits;
+}
+
+static float bitsFloat(unsigned int bits) {
+    float f;
+    memcpy(&f, &bits, 4);
+    return f;
+}
+
+// Appends one column of 16-bit values
+static void putColumn16(vector<unsigned char>& out, const short* values, int rows) {
+    size_t at = out.size();
+    out.resize(at + 2 * rows);
+    for (int i = 0; i < rows; i++) putLE16(&out[at + 2 * i], (unsigned short)values[i]);
+}
+
+static void getColumn16(const unsigned char* in, unsigned int rows, vector<short>& values) {
+    for (unsigned int i = 0; i < rows; i++) values.push_back((short)getLE16(in + 2 * i));
+}
+
+TelemetryRecorder::TelemetryRecorder()
+    : file(nullptr), ticks(0), lastScore(0), lastFuel(0), tickBase(0), tickRows(0), eventRows(0) {}
+
+TelemetryRecorder::~TelemetryRecorder() {
+    close();
+}
+
+bool TelemetryRecorder::open(const string& path, const string& player, const string& role, int tickMs) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        LOG_WARN("Could not create telemetry file %s", path.c_str());
+        return false;
+    }
+    ticks = tickBase = 0;
+    tickRows = eventRows = 0;
+    unsigned char header[HEADER_SIZE];
+    memcpy(header, "RHTL", 4);
+    putLE16(header + 4, TELEMETRY_VERSION);
+    putLE16(header + 6, tickMs);
+    putLE32(header + 8, (unsigned int)time(nullptr));
+    putLE32(header + 12, 0);
+    fwrite(header, 1, HEADER_SIZE, file);
+    vector<unsigned char> info(32, 0);
+    strncpy((char*)&info[0], player.c_str(), 19);
+    strncpy((char*)&info[20], role.c_str(), 11);
+    writeBlock("INFO", 0, 1, info);
+    LOG_INFO("Recording telemetry to %s", path.c_str());
+    return true;
+}
+
+void TelemetryRecorder::writeBlock(const char* tag, unsigned int firstTick, unsigned int rows,
+                                   const vector<unsigned char>& payload) {
+    unsigned char header[BLOCK_HEADER_SIZE];
+    memcpy(header, tag, 4);
+    putLE32(header + 4, firstTick);
+    putLE32(header + 8, rows);
+    putLE32(header + 12, (unsigned int)payload.size());
+    fwrite(header, 1, BLOCK_HEADER_SIZE, file);
+    fwrite(payload.data(), 1, payload.size(), file);
+}
+
+void TelemetryRecorder::flushTicks() {
+    if (tickRows == 0) return;
+    vector<unsigned char> payload;
+    payload.reserve(10 * tickRows);
+    putColumn16(payload, tickX, tickRows);
+    putColumn16(payload, tickY, tickRows);
+    putColumn16(payload, tickScore, tickRows);
+    size_t at = payload.size();
+    payload.resize(at + 4 * tickRows);
+    for (int i = 0; i < tickRows; i++) putLE32(&payload[at + 4 * i], floatBits(tickFuel[i]));
+    writeBlock("TICK", tickBase, tickRows, payload);
+    tickBase += tickRows;
+    tickRows = 0;
+}
+
+void TelemetryRecorder::flushEvents() {
+    if (eventRows == 0) return;
+    vector<unsigned char> payload(5 * eventRows);
+    for (int i = 0; i < eventRows; i++) putLE32(&payload[4 * i], eventTick[i]);
+    memcpy(&payload[4 * eventRows], eventType, eventRows);
+    putColumn16(payload, eventX, eventRows);
+    putColumn16(payload, eventY, eventRows);
+    putColumn16(payload, eventValue, eventRows);
+    writeBlock("EVNT", eventTick[0], eventRows, payload);
+    eventRows = 0;
+}
+
+// Writes out the pending ticks and events, so a session that crashes or is
+// killed loses at most one tick block
+void TelemetryRecorder::checkpoint() {
+    flushTicks();
+    flushEvents();
+    fflush(file);
+}
+
+void TelemetryRecorder::onEvents(const GameEvent* events, int count) {
+    if (!file) return;
+    for (int i = 0; i < count; i++) {
+        eventTick[eventRows] = ticks > 0 ? ticks - 1 : 0;
+        eventType[eventRows] = (unsigned char)events[i].type;
+        eventX[eventRows] = (short)events[i].x;
+        eventY[eventRows] = (short)events[i].y;
+        eventValue[eventRows] = (short)events[i].value;
+        if (++eventRows == EVENT_ROWS) flushEvents();
+        if (events[i].type == EVENT_GAME_OVER) {
+            finish(events[i].value ? OUTCOME_WON : OUTCOME_LOST);
+            return;
+        }
+    }
+}
+
+void TelemetryRecorder::finish(TelemetryOutcome outcome) {
+    flushTicks();
+    flushEvents();
+    vector<unsigned char> done(13);
+    putLE32(&done[0], (unsigned int)lastScore);
+    putLE32(&done[4], floatBits(lastFuel));
+    putLE32(&done[8], ticks);
+    done[12] = (unsigned char)outcome;
+    writeBlock("DONE", ticks, 1, done);
+    fclose(file);
+    file = nullptr;
+}
+
+void TelemetryRecorder::close() {
+    if (file) finish(OUTCOME_QUIT);
+}
+
+bool loadTelemetry(const string& path, TelemetrySession& session) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) return false;
+    vector<unsigned char> data;
+    unsigned char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0) data.insert(data.end(), chunk, chunk + n);
+    fclose(in);
+    if (data.size() < (size_t)HEADER_SIZE || memcmp(&data[0], "RHTL", 4) != 0) return false;
+    session = TelemetrySession();
+    session.version = getLE16(&data[4]);
+    session.tickMs = getLE16(&data[6]);
+    session.startTime = getLE32(&data[8]);
+    session.finished = false;
+    session.finalScore = 0;
+    session.finalFuel = 0;
+    session.outcome = OUTCOME_QUIT;
+    if (session.version != TELEMETRY_VERSION) {
+        LOG_WARN("%s: unsupported telemetry version %d", path.c_str(), session.version);
+        return false;
+    }
+    size_t pos = HEADER_SIZE;
+    while (pos + BLOCK_HEADER_SIZE <= data.size()) {
+        const unsigned char* block = &data[pos];
+        unsigned int rows = getLE32(block + 8);
+        unsigned int bytes = getLE32(block + 12);
+        if (bytes > data.size() - pos - BLOCK_HEADER_SIZE) break;
+        const unsigned char* p = block + BLOCK_HEADER_SIZE;
+        // sizes in 64 bits: a corrupt row count must not wrap round to a small one
+        if (memcmp(block, "INFO", 4) == 0 && bytes >= 32) {
+            session.player.assign((const char*)p, strnlen((const char*)p, 20));
+            session.role.assign((const char*)p + 20, strnlen((const char*)p + 20, 12));
+        } else if (memcmp(block, "TICK", 4) == 0 && bytes >= 10ULL * rows) {
+            getColumn16(p, rows, session.x);
+            getColumn16(p + 2 * rows, rows, session.y);
+            getColumn16(p + 4 * rows, rows, session.score);
+            for (unsigned int i = 0; i < rows; i++) session.fuel.push_back(bitsFloat(getLE32(p + 6 * rows + 4 * i)));
+        } else if (memcmp(block, "EVNT", 4) == 0 && bytes >= 11ULL * rows) {
+            for (unsigned int i = 0; i < rows; i++) session.eventTick.push_back(getLE32(p + 4 * i));
+            session.eventType.insert(session.eventType.end(), p + 4 * rows, p + 5 * rows);
+            getColumn16(p + 5 * rows, rows, session.eventX);
+            getColumn16(p + 7 * rows, rows, session.eventY);
+            getColumn16(p + 9 * rows, rows, session.eventValue);
+        } else if (memcmp(block, "DONE", 4) == 0 && bytes >= 13) {
+            session.finished = true;
+            session.finalScore = (int)getLE32(p);
+            session.finalFuel = bitsFloat(getLE32(p + 4));
+            session.outcome = (TelemetryOutcome)p[12];
+        }
+        pos += BLOCK_HEADER_SIZE + bytes;
+    }
+    return true;
+}
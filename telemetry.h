@@ -0,0 +1,102 @@
+/*
+ * telemetry.h
+ *
+ * Per-session telemetry. Every tick's player state and every game event is
+ * recorded into fixed column arrays; a full block is written out column by
+ * column, so a tick costs a few stores and analysis tools can read one
+ * column without touching the others.
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include "events.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+// On-disk layout, all integers little-endian:
+//   header  "RHTL" | u16 version | u16 tick length in ms | u32 unix start time | u32 flags
+//   block   char tag[4] | u32 first tick | u32 rows | u32 payload bytes | payload
+//     INFO  char player[20] | char role[12]
+//     TICK  i16 x[rows] | i16 y[rows] | i16 score[rows] | f32 fuel[rows]
+//     EVNT  u32 tick[rows] | u8 type[rows] | i16 x[rows] | i16 y[rows] | i16 value[rows]
+//     DONE  i32 score | f32 fuel | u32 ticks | u8 outcome
+// A session that was cut short simply has no DONE block.
+const int TELEMETRY_VERSION = 1;
+
+enum TelemetryOutcome { OUTCOME_LOST, OUTCOME_WON, OUTCOME_QUIT };
+
+class TelemetryRecorder : public GameEventListener {
+public:
+    static const int TICK_ROWS = 512;   // about 50 s at 100 ms ticks, so a game writes several
+    static const int EVENT_ROWS = 1024;
+private:
+    FILE* file;
+    unsigned int ticks;             // samples taken so far
+    int lastScore;
+    float lastFuel;
+
+    unsigned int tickBase;          // tick of row 0 in the pending tick block
+    int tickRows;
+    short tickX[TICK_ROWS], tickY[TICK_ROWS], tickScore[TICK_ROWS];
+    float tickFuel[TICK_ROWS];
+
+    int eventRows;
+    unsigned int eventTick[EVENT_ROWS];
+    unsigned char eventType[EVENT_ROWS];
+    short eventX[EVENT_ROWS], eventY[EVENT_ROWS], eventValue[EVENT_ROWS];
+
+    void writeBlock(const char* tag, unsigned int firstTick, unsigned int rows, const vector<unsigned char>& payload);
+    void flushTicks();
+    void flushEvents();
+    void checkpoint();
+    void finish(TelemetryOutcome outcome);
+public:
+    TelemetryRecorder();
+    ~TelemetryRecorder();
+    bool open(const string& path, const string& player, const string& role, int tickMs);
+    bool isOpen() const { return file != nullptr; }
+    // Once per simulation tick; only touches memory until a block fills up,
+    // then everything recorded so far goes to disk.
+    void sample(int x, int y, float fuel, int score) {
+        if (!file) return;
+        tickX[tickRows] = (short)x;
+        tickY[tickRows] = (short)y;
+        tickScore[tickRows] = (short)score;
+        tickFuel[tickRows] = fuel;
+        lastScore = score;
+        lastFuel = fuel;
+        ticks++;
+        if (++tickRows == TICK_ROWS) checkpoint();
+    }
+    // Records events against the latest tick; EVENT_GAME_OVER ends the session.
+    void onEvents(const GameEvent* events, int count) override;
+    // Ends a session that did not reach game over.
+    void close();
+};
+
+// A whole session read back into columns.
+struct TelemetrySession {
+    int version;
+    int tickMs;
+    unsigned int startTime;
+    string player, role;
+    vector<short> x, y, score;
+    vector<float> fuel;
+    vector<unsigned int> eventTick;
+    vector<unsigned char> eventType;
+    vector<short> eventX, eventY, eventValue;
+    bool finished;                  // has a DONE block
+    int finalScore;
+    float finalFuel;
+    TelemetryOutcome outcome;
+};
+
+// False if the file is missing or not telemetry. A truncated last block is ignored.
+bool loadTelemetry(const string& path, TelemetrySession& session);
+
+extern TelemetryRecorder telemetry;
+
+#endif /* TELEMETRY_H_ */
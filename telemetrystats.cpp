@@ -0,0 +1,110 @@
+/*
+ * telemetrystats.cpp
+ *
+ * Summarises telemetry sessions: where fuel and time went, how long each
+ * delivery took and what crashes cost. Reads only the columns it needs.
+ *
+ *   telemetrystats FILE...
+ */
+#include "telemetry.h"
+#include "log.h"
+#include <cstdio>
+#include <cstdlib>
+
+static const char* outcomeName(const TelemetrySession& s) {
+    if (!s.finished) return "cut short";
+    switch (s.outcome) {
+        case OUTCOME_WON: return "won";
+        case OUTCOME_LOST: return "lost";
+        default: return "quit";
+    }
+}
+
+struct Totals {
+    int sessions;
+    long long ticks, idleTicks, deliveries, deliveryTicks, crashes, crashCost;
+    double fuelDriven, fuelDelivering, fuelBought;
+};
+
+static void summarise(const string& path, const TelemetrySession& s, Totals& totals) {
+    size_t ticks = s.x.size();
+    double seconds = ticks * s.tickMs / 1000.0;
+    // fuel only goes up at a station, so rises are purchases and drops are driving
+    double driven = 0, bought = 0;
+    long long idle = 0;
+    for (size_t i = 1; i < ticks; i++) {
+        float change = s.fuel[i] - s.fuel[i - 1];
+        if (change < 0) driven -= change;
+        else bought += change;
+        if (s.x[i] == s.x[i - 1] && s.y[i] == s.y[i - 1]) idle++;
+    }
+    long long deliveries = 0, deliveryTicks = 0, crashes = 0, crashCost = 0;
+    double deliveryFuel = 0;
+    long long pickedUpAt = -1;
+    for (size_t i = 0; ticks > 0 && i < s.eventType.size(); i++) {
+        unsigned int t = s.eventTick[i] < ticks ? s.eventTick[i] : (unsigned int)ticks - 1;
+        switch (s.eventType[i]) {
+            case EVENT_PICKUP: pickedUpAt = t; break;
+            case EVENT_DROPOFF:
+                if (pickedUpAt >= 0) {
+                    deliveries++;
+                    deliveryTicks += t - pickedUpAt;
+                    deliveryFuel += s.fuel[pickedUpAt] - s.fuel[t];
+                    pickedUpAt = -1;
+                }
+                break;
+            case EVENT_COLLISION:
+            case EVENT_WALL_BUMP:
+                crashes++;
+                crashCost -= s.eventValue[i];
+                break;
+            default: break;
+        }
+    }
+    printf("%s: %s (%s), %s with %d points after %.1f s\n", path.c_str(), s.player.c_str(), s.role.c_str(),
+           outcomeName(s), s.finished ? s.finalScore : (ticks ? s.score[ticks - 1] : 0), seconds);
+    printf("  fuel: %.1f burned, %.1f bought; idle %.0f%% of the time\n", driven, bought,
+           ticks ? 100.0 * idle / ticks : 0.0);
+    if (deliveries > 0) {
+        printf("  %lld deliveries, %.1f s and %.1f fuel each on average\n", deliveries,
+               deliveryTicks * s.tickMs / 1000.0 / deliveries, deliveryFuel / deliveries);
+    }
+    printf("  %lld crashes costing %lld points\n", crashes, crashCost);
+    totals.sessions++;
+    totals.ticks += ticks;
+    totals.idleTicks += idle;
+    totals.deliveries += deliveries;
+    totals.deliveryTicks += deliveryTicks;
+    totals.crashes += crashes;
+    totals.crashCost += crashCost;
+    totals.fuelDriven += driven;
+    totals.fuelDelivering += deliveryFuel;
+    totals.fuelBought += bought;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: telemetrystats FILE...\n");
+        return 2;
+    }
+    logStart();
+    Totals totals = Totals();
+    for (int i = 1; i < argc; i++) {
+        TelemetrySession session;
+        if (!loadTelemetry(argv[i], session)) {
+            LOG_WARN("%s: not a telemetry file", argv[i]);
+            continue;
+        }
+        summarise(argv[i], session, totals);
+    }
+    if (totals.sessions > 1) {
+        printf("%d sessions, %lld ticks: %.1f fuel burned (%.0f%% while delivering), %.1f bought, idle %.0f%%, "
+               "%lld deliveries, %lld crashes costing %lld points\n",
+               totals.sessions, totals.ticks, totals.fuelDriven,
+               totals.fuelDriven > 0 ? 100.0 * totals.fuelDelivering / totals.fuelDriven : 0.0, totals.fuelBought,
+               totals.ticks ? 100.0 * totals.idleTicks / totals.ticks : 0.0, totals.deliveries, totals.crashes,
+               totals.crashCost);
+    }
+    logShutdown();
+    return totals.sessions > 0 ? 0 : 1;
+}
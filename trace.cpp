@@ -0,0 +1,118 @@
+/*
+ * trace.cpp
+ *
+ */
+#include "trace.h"
+#include "log.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct TraceEvent {
+    string name;
+    long long startUs;
+    long long durationUs;       // -1 for an instant
+    int thread;
+};
+
+atomic<bool> recording(false);
+mutex eventsMutex;
+vector<TraceEvent> events;
+vector<thread::id> threads;     // index is the tid shown in the trace
+const chrono::steady_clock::time_point epoch = chrono::steady_clock::now();
+
+long long nowUs() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+// Caller holds eventsMutex
+int threadIndex() {
+    thread::id self = this_thread::get_id();
+    for (size_t i = 0; i < threads.size(); i++) {
+        if (threads[i] == self) return (int)i;
+    }
+    threads.push_back(self);
+    return (int)threads.size() - 1;
+}
+
+void record(const string& name, long long startUs, long long durationUs) {
+    lock_guard<mutex> lock(eventsMutex);
+    if (!recording.load()) return;
+    events.push_back(TraceEvent{ name, startUs, durationUs, threadIndex() });
+}
+
+void writeEscaped(FILE* out, const string& s) {
+    for (char c : s) {
+        if (c == '"' || c == '\\') fputc('\\', out);
+        if ((unsigned char)c >= 0x20) fputc(c, out);
+    }
+}
+
+} // namespace
+
+void traceStart() {
+    lock_guard<mutex> lock(eventsMutex);
+    threadIndex();  // the main thread is tid 0
+    recording.store(true);
+}
+
+bool traceEnabled() {
+    return recording.load(memory_order_relaxed);
+}
+
+void traceInstant(const string& name) {
+    if (traceEnabled()) record(name, nowUs(), -1);
+}
+
+long long traceNow() {
+    return nowUs();
+}
+
+void traceSpan(const string& name, long long startUs) {
+    if (traceEnabled()) record(name, startUs, nowUs() - startUs);
+}
+
+bool traceWrite(const string& path) {
+    lock_guard<mutex> lock(eventsMutex);
+    if (!recording.exchange(false)) return false;
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        LOG_WARN("Could not write startup trace %s", path.c_str());
+        return false;
+    }
+    int pid = getpid();
+    fprintf(out, "{\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"main\"}}", pid);
+    for (const TraceEvent& e : events) {
+        fprintf(out, ",\n{\"name\":\"");
+        writeEscaped(out, e.name);
+        if (e.durationUs < 0) {
+            fprintf(out, "\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%lld,\"pid\":%d,\"tid\":%d}", e.startUs, pid, e.thread);
+        } else {
+            fprintf(out, "\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d}",
+                    e.startUs, e.durationUs, pid, e.thread);
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    LOG_INFO("Startup trace with %d events written to %s", (int)events.size(), path.c_str());
+    events.clear();
+    return true;
+}
+
+TraceScope::TraceScope(const string& spanName) : startUs(-1) {
+    if (traceEnabled()) {
+        name = spanName;
+        startUs = nowUs();
+    }
+}
+
+TraceScope::~TraceScope() {
+    if (startUs >= 0) record(name, startUs, nowUs() - startUs);
+}
@@ -0,0 +1,38 @@
+/*
+ * trace.h
+ *
+ * Startup profile in the Chrome trace-event format (open the file in
+ * chrome://tracing or Perfetto). Spans can be recorded from any thread
+ * until traceWrite() is called, normally when the first game frame is on
+ * screen; anything still running at that point was not on the path to the
+ * first frame and is left out.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <string>
+using namespace std;
+
+// Starts recording; before this every trace call is a no-op.
+void traceStart();
+bool traceEnabled();
+// A point in time, e.g. "first frame".
+void traceInstant(const string& name);
+// For spans that do not match a C++ scope: t = traceNow(); ...; traceSpan("name", t);
+long long traceNow();
+void traceSpan(const string& name, long long startUs);
+// Writes everything recorded so far and stops recording.
+bool traceWrite(const string& path);
+
+// Records the time from construction to destruction as one span.
+class TraceScope {
+private:
+    string name;
+    long long startUs;
+public:
+    explicit TraceScope(const string& spanName);
+    ~TraceScope();
+};
+
+#endif /* TRACE_H_ */
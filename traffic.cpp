@@ -0,0 +1,162 @@
+/*
+ * traffic.cpp
+ *
+ */
+#include "traffic.h"
+#include <algorithm>
+
+static const int SPEED = 2;
+static const int CARS_PER_JOB = 4096;
+
+// 30 random bits; two draws, in a fixed order
+static uint32_t random30(uint32_t& seed) {
+    uint32_t high = trafficRandom(seed);
+    return high << 15 | trafficRandom(seed);
+}
+
+const int32_t LaneGrid::NO_CAR;
+
+void LaneGrid::reset(int cityCells) {
+    cells = cityCells;
+    roadColumns = (cells + 3) / 4;
+    owner = vector<atomic<int32_t>>(slot(0, cells));
+    for (size_t s = 0; s < owner.size(); s++) setOwner(s, NO_CAR);
+}
+
+int LaneGrid::slot(int i, int j) const {
+    // Rows below j: every fourth is all road, the rest only cross the road columns
+    int fullRows = (j + 3) / 4;
+    int base = fullRows * cells + (j - fullRows) * roadColumns;
+    return j % 4 == 0 ? base + i : base + i / 4;
+}
+
+int LaneGrid::covered(int x, int y, int* slots) const {
+    int count = 0;
+    for (int j = y / CELL_SIZE; j <= (y + 39) / CELL_SIZE && j < cells; j++) {
+        for (int i = x / CELL_SIZE; i <= (x + 19) / CELL_SIZE && i < cells; i++) {
+            if (isCityRoad(i, j)) slots[count++] = slot(i, j);
+        }
+    }
+    return count;
+}
+
+bool LaneGrid::isFree(int x, int y) const {
+    int slots[4];
+    int count = covered(x, y, slots);
+    for (int s = 0; s < count; s++) {
+        if (ownerOf(slots[s]) != NO_CAR) return false;
+    }
+    return true;
+}
+
+void LaneGrid::place(int car, int x, int y) {
+    int slots[4];
+    int count = covered(x, y, slots);
+    for (int s = 0; s < count; s++) {
+        if (ownerOf(slots[s]) == NO_CAR) setOwner(slots[s], car);
+    }
+}
+
+void LaneGrid::remove(int car, int x, int y) {
+    int slots[4];
+    int count = covered(x, y, slots);
+    for (int s = 0; s < count; s++) {
+        if (ownerOf(slots[s]) == car) setOwner(slots[s], NO_CAR);
+    }
+}
+
+int32_t LaneGrid::claim(int car, int x, int y) {
+    int slots[4];
+    int count = covered(x, y, slots);
+    for (int s = 0; s < count; s++) {
+        int32_t other = ownerOf(slots[s]);
+        if (other != NO_CAR && other != car) return other;
+    }
+    for (int s = 0; s < count; s++) setOwner(slots[s], car);
+    return NO_CAR;
+}
+
+void LaneGrid::leave(int car, int x, int y, int newX, int newY) {
+    int before[4], after[4];
+    int count = covered(x, y, before);
+    int kept = covered(newX, newY, after);
+    for (int s = 0; s < count; s++) {
+        if (ownerOf(before[s]) != car || find(after, after + kept, before[s]) != after + kept) continue;
+        setOwner(before[s], NO_CAR);
+    }
+}
+
+TrafficBatch::TrafficBatch(int cityCells, int cars, uint32_t seed)
+    : cells(min(max(cityCells, 1), MAX_CITY_CELLS)), lanes(cells), blocked(0) {
+    // Cars go on the first road cells of a shuffle, one each
+    vector<uint32_t> road;
+    for (int j = 0; j < cells; j++) {
+        for (int i = 0; i < cells; i++) {
+            if (isCityRoad(i, j)) road.push_back(j * cells + i);
+        }
+    }
+    cars = min(max(cars, 0), (int)road.size());
+    xs.resize(cars);
+    ys.resize(cars);
+    directions.resize(cars);
+    seeds.resize(cars);
+    for (int k = 0; k < cars; k++) {
+        swap(road[k], road[k + random30(seed) % (road.size() - k)]);
+        xs[k] = road[k] % cells * CELL_SIZE;
+        ys[k] = road[k] / cells * CELL_SIZE;
+        directions[k] = trafficRandom(seed) % 4;
+        seeds[k] = random30(seed);
+        lanes.place(k, xs[k], ys[k]);
+    }
+}
+
+struct TrafficBatch::Cars {
+    TrafficBatch& batch;
+    int x(int k) const { return batch.xs[k]; }
+    int y(int k) const { return batch.ys[k]; }
+    TrafficMove plan(int k) const {
+        int x = batch.xs[k], y = batch.ys[k], direction = batch.directions[k];
+        uint32_t seed = batch.seeds[k];
+        trafficStep(x, y, direction, seed, batch.cells, SPEED);
+        return { (uint16_t)x, (uint16_t)y, seed, (uint8_t)direction };
+    }
+    TrafficMove wait(int k, int blocker) const {
+        int direction = batch.directions[k];
+        uint32_t seed = batch.seeds[k];
+        trafficBlocked(direction, seed, batch.directions[blocker]);
+        return { batch.xs[k], batch.ys[k], seed, (uint8_t)direction };
+    }
+    void apply(int k, const TrafficMove& move) {
+        batch.xs[k] = move.x;
+        batch.ys[k] = move.y;
+        batch.directions[k] = move.direction;
+        batch.seeds[k] = move.seed;
+    }
+};
+
+void TrafficBatch::tick(JobSystem* jobs) {
+    Cars cars = { *this };
+    blocked = laneTick(cars, size(), lanes, moves, jobs, CARS_PER_JOB);
+}
+
+size_t TrafficBatch::bytesPerCar() const {
+    size_t perCar = sizeof(xs[0]) + sizeof(ys[0]) + sizeof(directions[0]) + sizeof(seeds[0]) + sizeof(moves[0]);
+    return perCar + (size() ? lanes.bytes() / size() : 0);
+}
+
+uint64_t TrafficBatch::checksum() const {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int k = 0; k < size(); k++) {
+        hash = (hash ^ (xs[k] | (uint64_t)ys[k] << 16 | (uint64_t)directions[k] << 32)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+int TrafficBatch::citySizeFor(int cars) {
+    for (int cells = 5; cells < MAX_CITY_CELLS; cells += 4) {
+        int roadLines = (cells + 3) / 4;
+        long long roadCells = (long long)cells * cells - (long long)(cells - roadLines) * (cells - roadLines);
+        if (roadCells >= cars) return cells;
+    }
+    return MAX_CITY_CELLS;
+}
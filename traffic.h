@@ -0,0 +1,209 @@
+/*
+ * traffic.h
+ *
+ * The traffic rule, and traffic for cities far larger than the game's.
+ * TrafficBatch keeps its cars in parallel arrays: 16-bit pixel
+ * coordinates (cell * 40 + offset into the cell, enough for a city 1638
+ * cells wide), an 8-bit direction and the car's random seed, 9 bytes a
+ * car. Cars also keep out of each other's way through a LaneGrid, the
+ * same way World's traffic does, so a tick is three passes: every car
+ * works out its move, the moves claim road cells in car order, and the
+ * cars that got their cells move.
+ */
+
+#ifndef TRAFFIC_H_
+#define TRAFFIC_H_
+
+#include "jobs.h"
+#include <cstddef>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+const int CELL_SIZE = 40;
+const int MAX_CITY_CELLS = 65535 / CELL_SIZE;
+
+// Every fourth row and column of cells is road, starting at 0
+inline bool isCityRoad(int i, int j) {
+    return i % 4 == 0 || j % 4 == 0;
+}
+
+// rand_r's generator; each car has its own, so cars can move on any thread
+inline int trafficRandom(uint32_t& seed) {
+    seed = seed * 1103515245 + 12345;
+    return (seed / 65536) % 32768;
+}
+
+// Whether all of a 20x40 car at (x, y) is on an intersection cell
+inline bool onIntersection(int x, int y) {
+    return (x / CELL_SIZE) % 4 == 0 && (y / CELL_SIZE) % 4 == 0 && x % CELL_SIZE <= CELL_SIZE - 20 && y % CELL_SIZE == 0;
+}
+
+// One tick of a 20x40 car at (x, y) in a city `cells` cells on a side,
+// ignoring other cars. Directions are 0 up, 1 down, 2 left, 3 right. The
+// car drives straight on; when all of it has just come onto an
+// intersection cell it turns at random, but never back the way it came,
+// and when any of it would go off the map or off the road it stays put
+// and picks a new direction, so it never leaves its one-cell-wide road.
+inline void trafficStep(int& x, int& y, int& direction, uint32_t& seed, int cells, int speed) {
+    int newX = x, newY = y;
+    switch (direction) {
+        case 0: newY += speed; break;
+        case 1: newY -= speed; break;
+        case 2: newX -= speed; break;
+        case 3: newX += speed; break;
+    }
+    int size = cells * CELL_SIZE;
+    // Roads are one cell wide, so the car is on the road if its corners are
+    if (newX < 0 || newX > size - 20 || newY < 0 || newY > size - 40 ||
+        !isCityRoad(newX / CELL_SIZE, newY / CELL_SIZE) || !isCityRoad((newX + 19) / CELL_SIZE, newY / CELL_SIZE) ||
+        !isCityRoad(newX / CELL_SIZE, (newY + 39) / CELL_SIZE) || !isCityRoad((newX + 19) / CELL_SIZE, (newY + 39) / CELL_SIZE)) {
+        direction = trafficRandom(seed) % 4;
+        return;
+    }
+    bool arriving = !onIntersection(x, y) && onIntersection(newX, newY);
+    x = newX;
+    y = newY;
+    if (arriving) {
+        int back = direction ^ 1;
+        int turn;
+        do {
+            turn = trafficRandom(seed) % 4;
+        } while (turn == back);
+        direction = turn;
+    }
+}
+
+// A car that cannot go on because `blocker` is in the way waits behind
+// it. Facing an oncoming car, which would wait for it in turn, it picks a
+// new direction instead, and so, now and then, does a car that is only
+// queueing, which undoes gridlock around a block.
+inline void trafficBlocked(int& direction, uint32_t& seed, int blockerDirection) {
+    if (blockerDirection == (direction ^ 1) || trafficRandom(seed) % 32 == 0) direction = trafficRandom(seed) % 4;
+}
+
+// Where a car will be after this tick, worked out before any car moves
+struct TrafficMove {
+    uint16_t x, y;
+    uint32_t seed;
+    uint8_t direction;
+};
+
+// Which car is on each road cell. Roads are one car wide, so a cell is
+// one slot of a lane shared by both directions and holds at most one car;
+// a 20x40 car covers the one or two cells its box overlaps. A car that
+// moves into a cell claims it first, so two cars never overlap. Only road
+// cells are stored, a word each, and any cell is found in O(1).
+class LaneGrid {
+private:
+    int cells;
+    int roadColumns;            // road cells in a row that is not all road
+    // Per road cell, the car on it or NO_CAR. Relaxed atomics: while cars
+    // leave cells in parallel, a car overlapping one it does not own (a
+    // stacked copy, a car that could not be placed) may read it as its
+    // owner frees it.
+    vector<atomic<int32_t>> owner;
+    int32_t ownerOf(int slot) const { return owner[slot].load(memory_order_relaxed); }
+    void setOwner(int slot, int32_t car) { owner[slot].store(car, memory_order_relaxed); }
+    int slot(int i, int j) const;
+    // Slots of the road cells a car at (x, y) covers, at most 4; returns how many
+    int covered(int x, int y, int* slots) const;
+public:
+    static const int32_t NO_CAR = -1;
+    // Whether a car covers the same cells at (x, y) as at (newX, newY), as
+    // it does for all but one tick in twenty; claim and leave are then free
+    static bool sameCells(int x, int y, int newX, int newY) {
+        return x / CELL_SIZE == newX / CELL_SIZE && (x + 19) / CELL_SIZE == (newX + 19) / CELL_SIZE &&
+               y / CELL_SIZE == newY / CELL_SIZE && (y + 39) / CELL_SIZE == (newY + 39) / CELL_SIZE;
+    }
+    explicit LaneGrid(int cells = 0) { reset(cells); }
+    // Empties the grid and sizes it for a city `cells` cells on a side
+    void reset(int cells);
+    // Whether every road cell a car at (x, y) would cover is free
+    bool isFree(int x, int y) const;
+    // Marks the cells a car at (x, y) covers as its own, skipping any
+    // another car already has
+    void place(int car, int x, int y);
+    // Frees the cells a car at (x, y) covers that are still its own
+    void remove(int car, int x, int y);
+    // Claims for `car` every cell it would cover at (x, y). If another car
+    // has one of them, claims nothing and returns that car.
+    int32_t claim(int car, int x, int y);
+    // Frees the cells `car` covered at (x, y) that it does not at (newX, newY);
+    // cars may do this in parallel, as each only touches its own cells.
+    void leave(int car, int x, int y, int newX, int newY);
+    size_t bytes() const { return owner.size() * sizeof(owner[0]); }
+};
+
+// One tick of cars that keep out of each other's way, for World and
+// TrafficBatch alike. `cars` tells it, for car k: x(k) and y(k); plan(k),
+// the move the traffic rule makes; wait(k, blocker), the move it makes
+// instead when car `blocker` is in the way; and apply(k, move). Every car
+// plans its move, the moves claim their cells in car order on this
+// thread, so the lower-numbered car gets a contested cell and the result
+// does not depend on the threads, and then every car moves. Planning and
+// moving are split across jobs, `grain` cars at least, if there are any.
+// Returns how many cars waited.
+template <class Cars>
+int laneTick(Cars& cars, int count, LaneGrid& lanes, vector<TrafficMove>& moves, JobSystem* jobs, int grain) {
+    moves.resize(count);
+    function<void(int, int)> plan = [&](int begin, int end) {
+        for (int k = begin; k < end; k++) moves[k] = cars.plan(k);
+    };
+    // each car only frees cells it had, so this can run in parallel
+    function<void(int, int)> apply = [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            int x = cars.x(k), y = cars.y(k);
+            if (!LaneGrid::sameCells(x, y, moves[k].x, moves[k].y)) lanes.leave(k, x, y, moves[k].x, moves[k].y);
+            cars.apply(k, moves[k]);
+        }
+    };
+    if (jobs) jobs->parallelFor(count, grain, plan);
+    else plan(0, count);
+    int waiting = 0;
+    for (int k = 0; k < count; k++) {
+        if (LaneGrid::sameCells(cars.x(k), cars.y(k), moves[k].x, moves[k].y)) continue;
+        int32_t blocker = lanes.claim(k, moves[k].x, moves[k].y);
+        if (blocker == LaneGrid::NO_CAR) continue;
+        waiting++;
+        moves[k] = cars.wait(k, blocker);
+    }
+    if (jobs) jobs->parallelFor(count, grain, apply);
+    else apply(0, count);
+    return waiting;
+}
+
+class TrafficBatch {
+private:
+    struct Cars;                // what laneTick needs to know about the arrays
+    int cells;
+    vector<uint16_t> xs, ys;
+    vector<uint8_t> directions;
+    vector<uint32_t> seeds;
+    LaneGrid lanes;
+    vector<TrafficMove> moves;  // tick: where each car is going
+    int blocked;
+public:
+    // `cars` cars, one to a random road cell, in a city `cells` cells on a
+    // side (at most MAX_CITY_CELLS); there are fewer if the road cells run
+    // out. The same seed gives the same city.
+    TrafficBatch(int cells, int cars, uint32_t seed);
+    int size() const { return (int)xs.size(); }
+    int cityCells() const { return cells; }
+    // Moves every car once, split across jobs if there are any; the
+    // result does not depend on how many threads run it.
+    void tick(JobSystem* jobs);
+    // Cars the last tick kept from moving because another was in the way
+    int waiting() const { return blocked; }
+    // Bytes the cars, the tick's moves and the lanes take, per car
+    size_t bytesPerCar() const;
+    // Of every position and direction, to check two runs did the same thing
+    uint64_t checksum() const;
+    // The smallest city of the game's shape (roads on both edges) with at
+    // least `cars` road cells; a batch that is to keep moving wants a few
+    // cells per car
+    static int citySizeFor(int cars);
+};
+
+#endif /* TRAFFIC_H_ */
@@ -3,6 +3,131 @@
  *
  */
 #include "util.h"
+
+// set of colors ...
+float colors[][3] = { { 0.501960784313726, 0, 0 }, { 0.545098039215686,
+		0, 0 }, { 0.647058823529412, 0.164705882352941, 0.164705882352941 }, {
+		0.698039215686275, 0.133333333333333, 0.133333333333333 }, {
+		0.862745098039216, 0.0784313725490196, 0.235294117647059 }, { 1, 0, 0 },
+		{ 1, 0.388235294117647, 0.278431372549020 }, { 1, 0.498039215686275,
+				0.313725490196078 }, { 0.803921568627451, 0.360784313725490,
+				0.360784313725490 }, { 0.941176470588235, 0.501960784313726,
+				0.501960784313726 }, { 0.913725490196078, 0.588235294117647,
+				0.478431372549020 },
+		{ 1, 0.627450980392157, 0.478431372549020 },
+		{ 1, 0.270588235294118, 0 }, { 1, 0.549019607843137, 0 }, { 1,
+				0.647058823529412, 0 }, { 1, 0.843137254901961, 0 }, {
+				0.721568627450980, 0.525490196078431, 0.0431372549019608 }, {
+				0.854901960784314, 0.647058823529412, 0.125490196078431 }, {
+				0.933333333333333, 0.909803921568627, 0.666666666666667 }, {
+				0.741176470588235, 0.717647058823529, 0.419607843137255 }, {
+				0.941176470588235, 0.901960784313726, 0.549019607843137 }, {
+				0.501960784313726, 0.501960784313726, 0 }, { 1, 1, 0 }, {
+				0.603921568627451, 0.803921568627451, 0.196078431372549 }, {
+				0.333333333333333, 0.419607843137255, 0.184313725490196 }, {
+				0.419607843137255, 0.556862745098039, 0.137254901960784 }, {
+				0.486274509803922, 0.988235294117647, 0 }, { 0.498039215686275,
+				1, 0 }, { 0.678431372549020, 1, 0.184313725490196 }, { 0,
+				0.392156862745098, 0 }, { 0, 0.501960784313726, 0 }, {
+				0.133333333333333, 0.545098039215686, 0.133333333333333 }, { 0,
+				1, 0 }, { 0.196078431372549, 0.803921568627451,
+				0.196078431372549 }, { 0.564705882352941, 0.933333333333333,
+				0.564705882352941 }, { 0.596078431372549, 0.984313725490196,
+				0.596078431372549 }, { 0.560784313725490, 0.737254901960784,
+				0.560784313725490 },
+		{ 0, 0.980392156862745, 0.603921568627451 },
+		{ 0, 1, 0.498039215686275 }, { 0.180392156862745, 0.545098039215686,
+				0.341176470588235 }, { 0.400000000000000, 0.803921568627451,
+				0.666666666666667 }, { 0.235294117647059, 0.701960784313725,
+				0.443137254901961 }, { 0.125490196078431, 0.698039215686275,
+				0.666666666666667 }, { 0.184313725490196, 0.309803921568627,
+				0.309803921568627 },
+		{ 0, 0.501960784313726, 0.501960784313726 }, { 0, 0.545098039215686,
+				0.545098039215686 }, { 0, 1, 1 }, { 0, 1, 1 }, {
+				0.878431372549020, 1, 1 }, { 0, 0.807843137254902,
+				0.819607843137255 }, { 0.250980392156863, 0.878431372549020,
+				0.815686274509804 }, { 0.282352941176471, 0.819607843137255,
+				0.800000000000000 }, { 0.686274509803922, 0.933333333333333,
+				0.933333333333333 },
+		{ 0.498039215686275, 1, 0.831372549019608 }, { 0.690196078431373,
+				0.878431372549020, 0.901960784313726 }, { 0.372549019607843,
+				0.619607843137255, 0.627450980392157 }, { 0.274509803921569,
+				0.509803921568627, 0.705882352941177 }, { 0.392156862745098,
+				0.584313725490196, 0.929411764705882 }, { 0, 0.749019607843137,
+				1 }, { 0.117647058823529, 0.564705882352941, 1 }, {
+				0.678431372549020, 0.847058823529412, 0.901960784313726 }, {
+				0.529411764705882, 0.807843137254902, 0.921568627450980 }, {
+				0.529411764705882, 0.807843137254902, 0.980392156862745 }, {
+				0.0980392156862745, 0.0980392156862745, 0.439215686274510 }, {
+				0, 0, 0.501960784313726 }, { 0, 0, 0.545098039215686 }, { 0, 0,
+				0.803921568627451 }, { 0, 0, 1 }, { 0.254901960784314,
+				0.411764705882353, 0.882352941176471 }, { 0.541176470588235,
+				0.168627450980392, 0.886274509803922 }, { 0.294117647058824, 0,
+				0.509803921568627 }, { 0.282352941176471, 0.239215686274510,
+				0.545098039215686 }, { 0.415686274509804, 0.352941176470588,
+				0.803921568627451 }, { 0.482352941176471, 0.407843137254902,
+				0.933333333333333 }, { 0.576470588235294, 0.439215686274510,
+				0.858823529411765 },
+		{ 0.545098039215686, 0, 0.545098039215686 }, { 0.580392156862745, 0,
+				0.827450980392157 }, { 0.600000000000000, 0.196078431372549,
+				0.800000000000000 }, { 0.729411764705882, 0.333333333333333,
+				0.827450980392157 },
+		{ 0.501960784313726, 0, 0.501960784313726 }, { 0.847058823529412,
+				0.749019607843137, 0.847058823529412 }, { 0.866666666666667,
+				0.627450980392157, 0.866666666666667 }, { 0.933333333333333,
+				0.509803921568627, 0.933333333333333 }, { 1, 0, 1 }, {
+				0.854901960784314, 0.439215686274510, 0.839215686274510 }, {
+				0.780392156862745, 0.0823529411764706, 0.521568627450980 }, {
+				0.858823529411765, 0.439215686274510, 0.576470588235294 }, { 1,
+				0.0784313725490196, 0.576470588235294 }, { 1, 0.411764705882353,
+				0.705882352941177 },
+		{ 1, 0.713725490196078, 0.756862745098039 }, { 1, 0.752941176470588,
+				0.796078431372549 }, { 0.980392156862745, 0.921568627450980,
+				0.843137254901961 }, { 0.960784313725490, 0.960784313725490,
+				0.862745098039216 },
+		{ 1, 0.894117647058824, 0.768627450980392 }, { 1, 0.921568627450980,
+				0.803921568627451 }, { 0.960784313725490, 0.870588235294118,
+				0.701960784313725 },
+		{ 1, 0.972549019607843, 0.862745098039216 }, { 1, 0.980392156862745,
+				0.803921568627451 }, { 0.980392156862745, 0.980392156862745,
+				0.823529411764706 }, { 1, 1, 0.878431372549020 }, {
+				0.545098039215686, 0.270588235294118, 0.0745098039215686 }, {
+				0.627450980392157, 0.321568627450980, 0.176470588235294 }, {
+				0.823529411764706, 0.411764705882353, 0.117647058823529 }, {
+				0.803921568627451, 0.521568627450980, 0.247058823529412 }, {
+				0.956862745098039, 0.643137254901961, 0.376470588235294 }, {
+				0.870588235294118, 0.721568627450980, 0.529411764705882 }, {
+				0.823529411764706, 0.705882352941177, 0.549019607843137 }, {
+				0.737254901960784, 0.560784313725490, 0.560784313725490 }, { 1,
+				0.894117647058824, 0.709803921568628 }, { 1, 0.870588235294118,
+				0.678431372549020 },
+		{ 1, 0.854901960784314, 0.725490196078431 }, { 1, 0.894117647058824,
+				0.882352941176471 },
+		{ 1, 0.941176470588235, 0.960784313725490 }, { 0.980392156862745,
+				0.941176470588235, 0.901960784313726 }, { 0.992156862745098,
+				0.960784313725490, 0.901960784313726 }, { 1, 0.937254901960784,
+				0.835294117647059 },
+		{ 1, 0.960784313725490, 0.933333333333333 }, { 0.960784313725490, 1,
+				0.980392156862745 }, { 0.439215686274510, 0.501960784313726,
+				0.564705882352941 }, { 0.466666666666667, 0.533333333333333,
+				0.600000000000000 }, { 0.690196078431373, 0.768627450980392,
+				0.870588235294118 }, { 0.901960784313726, 0.901960784313726,
+				0.980392156862745 },
+		{ 1, 0.980392156862745, 0.941176470588235 }, { 0.941176470588235,
+				0.972549019607843, 1 }, { 0.972549019607843, 0.972549019607843,
+				1 }, { 0.941176470588235, 1, 0.941176470588235 }, { 1, 1,
+				0.941176470588235 }, { 0.941176470588235, 1, 1 }, { 1,
+				0.980392156862745, 0.980392156862745 }, { 0.411764705882353,
+				0.411764705882353, 0.411764705882353 }, { 0.501960784313726,
+				0.501960784313726, 0.501960784313726 }, { 0.662745098039216,
+				0.662745098039216, 0.662745098039216 }, { 0.752941176470588,
+				0.752941176470588, 0.752941176470588 }, { 0.827450980392157,
+				0.827450980392157, 0.827450980392157 }, { 0.862745098039216,
+				0.862745098039216, 0.862745098039216 }, { 0.980392156862745,
+				0.501960784313726, 0.447058823529412 }, { 0.960784313725490,
+				0.960784313725490, 0.960784313725490 }, { 1, 1, 1 },
+		{ 0, 0, 0 }, { 0.734375, 0.734375, 0.734375} };
+
 /*
  * This function converts an input angle from degree to radians */
 float Deg2Rad(float degree) {
@@ -454,22 +579,3 @@ string Num2Str(int t) {
 	return s.str();
 }
 
-void ReadImage(string imgname, vector<unsigned char> &imgArray) {
-	using namespace cimg_library;
-	CImg<unsigned char> img(imgname.c_str());
-	imgArray.resize(img.height() * img.width() * 3, 0);
-	int k = 0;
-	unsigned char *rp = img.data();
-	unsigned char *gp = img.data() + img.height() * img.width();
-	unsigned char *bp = gp + img.height() * img.width();
-
-	for (int j = 0; j < img.width(); ++j) {
-		int t = j;
-		for (int i = 0; i < img.height(); ++i, t += img.width()) {
-			imgArray[k++] = rp[t];
-			imgArray[k++] = gp[t];
-			imgArray[k++] = bp[t];
-		}
-		//imgArray[i][j] = img[k++];
-	}
-}
@@ -0,0 +1,71 @@
+/*
+ * voices.cpp
+ *
+ */
+#include "voices.h"
+#include <cstdio>
+
+VoiceManager::VoiceManager(int channels)
+    : numChannels(channels < 1 ? 1 : channels > MAX_CHANNELS ? MAX_CHANNELS : channels),
+      played(0), coalesced(0), restarted(0), stolen(0), dropped(0) {
+    for (int i = 0; i < MAX_CHANNELS; i++) voices[i] = Voice{ -1, 0, 0, 0 };
+    for (int e = 0; e < SOUND_EFFECT_COUNT; e++) {
+        policies[e] = EffectPolicy{ 1, 0, numChannels };
+        lengthMs[e] = 0;
+        lastStart[e] = -1000000;
+    }
+}
+
+int VoiceManager::request(SoundEffect effect, long long nowMs) {
+    const EffectPolicy& policy = policies[effect];
+    if (nowMs - lastStart[effect] < policy.coalesceMs) {
+        coalesced++;
+        return -1;
+    }
+    int sameCount = 0, oldestSame = -1, freeChannel = -1, victim = -1;
+    for (int c = 0; c < numChannels; c++) {
+        const Voice& v = voices[c];
+        if (v.effect < 0 || v.endMs <= nowMs) {
+            if (freeChannel < 0) freeChannel = c;
+        } else if (v.effect == effect) {
+            sameCount++;
+            if (oldestSame < 0 || v.startMs < voices[oldestSame].startMs) oldestSame = c;
+        } else if (v.priority < policy.priority &&
+                   (victim < 0 || v.priority < voices[victim].priority ||
+                    (v.priority == voices[victim].priority && v.startMs < voices[victim].startMs))) {
+            victim = c;
+        }
+    }
+    int channel;
+    if (sameCount >= policy.maxVoices) {
+        channel = oldestSame;
+        restarted++;
+    } else if (freeChannel >= 0) {
+        channel = freeChannel;
+    } else if (victim >= 0) {
+        channel = victim;
+        stolen++;
+    } else {
+        dropped++;
+        return -1;
+    }
+    voices[channel] = Voice{ effect, policy.priority, nowMs, nowMs + lengthMs[effect] };
+    lastStart[effect] = nowMs;
+    played++;
+    return channel;
+}
+
+int VoiceManager::activeVoices(long long nowMs) const {
+    int n = 0;
+    for (int c = 0; c < numChannels; c++) {
+        if (voices[c].effect >= 0 && voices[c].endMs > nowMs) n++;
+    }
+    return n;
+}
+
+string VoiceManager::summary() const {
+    char text[160];
+    snprintf(text, sizeof(text), "%lld played (%lld restarted, %lld stole a channel), %lld coalesced, %lld dropped",
+             played, restarted, stolen, coalesced, dropped);
+    return text;
+}
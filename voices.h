@@ -0,0 +1,53 @@
+/*
+ * voices.h
+ *
+ * Decides which sound effects actually get a mixer channel. Repeats of an
+ * effect within its coalescing window are merged into the voice already
+ * playing, each effect has a cap on simultaneous voices, and when every
+ * channel is busy a new sound may only take over one playing something
+ * less important. Pure policy: it knows nothing about SDL, callers play
+ * the chunk on the channel it hands back.
+ */
+
+#ifndef VOICES_H_
+#define VOICES_H_
+
+#include <string>
+using namespace std;
+
+enum SoundEffect { SOUND_COLLISION, SOUND_DROPOFF, SOUND_REFUEL, SOUND_EFFECT_COUNT };
+
+struct EffectPolicy {
+    int priority;       // higher wins when channels run out
+    int coalesceMs;     // repeats closer together than this are dropped
+    int maxVoices;      // simultaneous voices; beyond this the oldest one restarts
+};
+
+class VoiceManager {
+public:
+    static const int MAX_CHANNELS = 32;
+private:
+    struct Voice {
+        int effect;         // -1 when the channel has never been used
+        int priority;
+        long long startMs, endMs;
+    };
+    Voice voices[MAX_CHANNELS];
+    int numChannels;
+    EffectPolicy policies[SOUND_EFFECT_COUNT];
+    int lengthMs[SOUND_EFFECT_COUNT];
+    long long lastStart[SOUND_EFFECT_COUNT];
+    long long played, coalesced, restarted, stolen, dropped;
+public:
+    explicit VoiceManager(int channels);
+    void setPolicy(SoundEffect effect, const EffectPolicy& policy) { policies[effect] = policy; }
+    // How long one play of the effect lasts; a voice is busy until then.
+    void setLength(SoundEffect effect, int ms) { lengthMs[effect] = ms; }
+    // Channel to play `effect` on at `nowMs` (it may still be playing
+    // something else, which the new sound replaces), or -1 to skip it.
+    int request(SoundEffect effect, long long nowMs);
+    int activeVoices(long long nowMs) const;
+    string summary() const;
+};
+
+#endif /* VOICES_H_ */
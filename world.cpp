@@ -0,0 +1,455 @@
+/*
+ * world.cpp
+ *
+ */
+#include "world.h"
+#include "aabb.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+void drawCarBody(int x, int y, float* color) {
+    DrawRoundRect(x, y, 20, 40, color, 10);
+    DrawCircle(x + 2, y + 4, 3, colors[BLACK]);
+    DrawCircle(x + 2, y + 32, 3, colors[BLACK]);
+    DrawCircle(x + 18, y + 4, 3, colors[BLACK]);
+    DrawCircle(x + 18, y + 32, 3, colors[BLACK]);
+}
+
+bool collides(const Vehicle& v1, const Vehicle& v2) {
+    return v1.x < v2.x + 20 && v1.x + 20 > v2.x &&
+           v1.y < v2.y + 40 && v1.y + 40 > v2.y;
+}
+
+bool isRoadCell(int i, int j) {
+    return (i == 0 || i == 4 || i == 8 || i == 12 || i == 16 ||
+            j == 0 || j == 4 || j == 8 || j == 12 || j == 16);
+}
+
+Position getRandomRoadPosition() {
+    while (true) {
+        int i = rand() % 17;
+        int j = rand() % 17;
+        if (isRoadCell(i, j)) {
+            return {i * 40, j * 40};
+        }
+    }
+}
+
+Position getRandomAdjacentBuildingPosition(const Position* occupied, int count) {
+    while (true) {
+        int i = rand() % 17;
+        int j = rand() % 17;
+        if (!isRoadCell(i, j)) {
+            bool adjacent = (i > 0 && isRoadCell(i - 1, j)) ||
+                           (i < 16 && isRoadCell(i + 1, j)) ||
+                           (j > 0 && isRoadCell(i, j - 1)) ||
+                           (j < 16 && isRoadCell(i, j + 1));
+            if (adjacent) {
+                int x = i * 40, y = j * 40;
+                bool available = true;
+                for (int k = 0; k < count; k++) {
+                    if (occupied[k].x == x && occupied[k].y == y) {
+                        available = false;
+                        break;
+                    }
+                }
+                if (available) return {x, y};
+            }
+        }
+    }
+}
+
+void Roads::drawRoads() const {
+    for (int i = 0; i < 17; ++i) {
+        for (int j = 0; j < 17; ++j) {
+            if (isRoadCell(i, j)) {
+                DrawSquare(i * 40, j * 40, 40, colors[WHITE]);
+            }
+        }
+    }
+}
+
+void Passenger::draw() const {
+    if (active) {
+        DrawCircle(x + 20, y + 30, 5, colors[RED]);
+        DrawLine(x + 20, y + 25, x + 20, y + 10, 2, colors[BLUE]);
+        DrawLine(x + 20, y + 20, x + 15, y + 15, 2, colors[BLUE]);
+        DrawLine(x + 20, y + 20, x + 25, y + 15, 2, colors[BLUE]);
+        DrawLine(x + 20, y + 10, x + 15, y + 5, 2, colors[BLUE]);
+        DrawLine(x + 20, y + 10, x + 25, y + 5, 2, colors[BLUE]);
+    }
+}
+
+bool PlayerCar::refuel() {
+    if (money >= 1) {
+        setFuel(getFuel() + 2);
+        addMoney(-1);
+        gameEvents.push(EVENT_REFUEL, x, y);
+        return true;
+    } else {
+        gameEvents.push(EVENT_REFUEL_FAILED, x, y);
+        return false;
+    }
+}
+
+void Taxi::pickUp() {
+    if (fuel > 0 && !hasPassenger) {
+        for (int i = 0; i < gameState.getActivePickupItems(); i++) {
+            PickupItem* p = gameState.getPickupItem(i);
+            if (p && p->isActive() && abs(x - p->getX()) <= 40 && abs(y - p->getY()) <= 40) {
+                p->setActive(false);
+                hasPassenger = true;
+                Position destPos = getRandomAdjacentBuildingPosition(nullptr, 0);
+                destination->setPosition(destPos.x, destPos.y);
+                gameEvents.push(EVENT_PICKUP, x, y);
+                fuel -= 1;
+                break;
+            }
+        }
+    }
+}
+
+bool Taxi::dropOff() {
+    if (fuel > 0 && hasPassenger && destination->isActive() &&
+        abs(x - destination->getX()) <= 40 && abs(y - destination->getY()) <= 40) {
+        hasPassenger = false;
+        destination->setActive(false);
+        addScore(20);
+        addMoney(20);
+        gameEvents.push(EVENT_DROPOFF, x, y, 20);
+        fuel -= 1;
+        for (int i = 0; i < gameState.getActivePickupItems(); i++) {
+            PickupItem* p = gameState.getPickupItem(i);
+            if (p && !p->isActive()) {
+                Position newPos = getRandomAdjacentBuildingPosition(nullptr, 0);
+                p->setPosition(newPos.x, newPos.y);
+                p->setActive(true);
+                break;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+void DeliveryCar::pickUp() {
+    if (fuel > 0 && !hasPackage) {
+        for (int i = 0; i < gameState.getActivePickupItems(); i++) {
+            PickupItem* p = gameState.getPickupItem(i);
+            if (p && p->isActive() && abs(x - p->getX()) <= 40 && abs(y - p->getY()) <= 40) {
+                p->setActive(false);
+                hasPackage = true;
+                Position destPos = getRandomAdjacentBuildingPosition(nullptr, 0);
+                destination->setPosition(destPos.x, destPos.y);
+                gameEvents.push(EVENT_PICKUP, x, y);
+                fuel -= 1;
+                break;
+            }
+        }
+    }
+}
+
+bool DeliveryCar::dropOff() {
+    if (fuel > 0 && hasPackage && destination->isActive() &&
+        abs(x - destination->getX()) <= 40 && abs(y - destination->getY()) <= 40) {
+        hasPackage = false;
+        destination->setActive(false);
+        addScore(20);
+        addMoney(20);
+        gameEvents.push(EVENT_DROPOFF, x, y, 20);
+        fuel -= 1;
+        for (int i = 0; i < gameState.getActivePickupItems(); i++) {
+            PickupItem* p = gameState.getPickupItem(i);
+            if (p && !p->isActive()) {
+                Position newPos = getRandomAdjacentBuildingPosition(nullptr, 0);
+                p->setPosition(newPos.x, newPos.y);
+                p->setActive(true);
+                break;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+void OtherCar::move() {
+    trafficStep(x, y, direction, seed, 17, MOVE_SPEED);
+}
+
+TrafficMove OtherCar::plan() const {
+    int newX = x, newY = y, newDirection = direction;
+    uint32_t newSeed = seed;
+    trafficStep(newX, newY, newDirection, newSeed, 17, MOVE_SPEED);
+    return { (uint16_t)newX, (uint16_t)newY, newSeed, (uint8_t)newDirection };
+}
+
+TrafficMove OtherCar::wait(const OtherCar& blocker) const {
+    int newDirection = direction;
+    uint32_t newSeed = seed;
+    trafficBlocked(newDirection, newSeed, blocker.direction);
+    return { (uint16_t)x, (uint16_t)y, newSeed, (uint8_t)newDirection };
+}
+
+void OtherCar::apply(const TrafficMove& move) {
+    x = move.x;
+    y = move.y;
+    direction = move.direction;
+    seed = move.seed;
+}
+
+bool OtherCar::resetPosition(const Vehicle* player, LaneGrid& lanes, int index) {
+    lanes.remove(index, x, y);
+    for (int tries = 0; tries < 64; tries++) {
+        Position pos = getRandomRoadPosition();
+        if (abs(pos.x - player->x) < 20 && abs(pos.y - player->y) < 40) continue;
+        if (!lanes.isFree(pos.x, pos.y)) continue;
+        x = pos.x;
+        y = pos.y;
+        direction = rand() % 4;
+        lanes.place(index, x, y);
+        return true;
+    }
+    lanes.place(index, x, y);
+    return false;
+}
+
+WorldLayout generateWorld(int numTraffic) {
+    const Position playerStart = {0, 640};
+    const int roadCells = 17 * 17 - 12 * 12;
+    WorldLayout layout;
+    numTraffic = min(numTraffic, roadCells - 1);
+    for (int i = 0; i < numTraffic; i++) {
+        Position pos;
+        bool taken;
+        do {
+            pos = getRandomRoadPosition();
+            taken = pos.x == playerStart.x && pos.y == playerStart.y;
+            for (int j = 0; j < i && !taken; j++) {
+                if (pos.x == layout.traffic[j].x && pos.y == layout.traffic[j].y) taken = true;
+            }
+        } while (taken);
+        layout.traffic.push_back(pos);
+    }
+    Position occupied[7];
+    int occupiedCount = 0;
+    for (int i = 0; i < 3; i++) {
+        layout.stations[i] = getRandomAdjacentBuildingPosition(occupied, occupiedCount);
+        occupied[occupiedCount++] = layout.stations[i];
+    }
+    layout.numItems = 2 + rand() % 3;
+    for (int i = 0; i < layout.numItems; i++) {
+        layout.items[i] = getRandomAdjacentBuildingPosition(occupied, occupiedCount);
+        occupied[occupiedCount++] = layout.items[i];
+    }
+    return layout;
+}
+
+void World::populate(const WorldLayout& layout, bool taxi) {
+    delete player;
+    if (taxi) {
+        player = new Taxi(0, 640, colors[YELLOW], 100.0, 0.0, state);
+    } else {
+        player = new DeliveryCar(0, 640, colors[RED], 100.0, 0.0, state);
+    }
+    traffic.clear();
+    traffic.reserve(layout.traffic.size());
+    for (size_t i = 0; i < layout.traffic.size(); i++) traffic.push_back(OtherCar(layout.traffic[i].x, layout.traffic[i].y));
+    lanes.reset(17);
+    for (size_t i = 0; i < traffic.size(); i++) lanes.place((int)i, traffic[i].x, traffic[i].y);
+    stuck.clear();
+    for (int i = 0; i < 3; i++) {
+        delete state.getFuelStation(i);
+        state.setFuelStation(i, new FuelStation(layout.stations[i].x, layout.stations[i].y));
+    }
+    for (int i = 0; i < 4; i++) {
+        delete state.getPickupItem(i);
+        state.setPickupItem(i, nullptr);
+    }
+    state.setActivePickupItems(layout.numItems);
+    for (int i = 0; i < layout.numItems; i++) {
+        if (taxi) {
+            state.setPickupItem(i, new Passenger(layout.items[i].x, layout.items[i].y));
+        } else {
+            state.setPickupItem(i, new Box(layout.items[i].x, layout.items[i].y));
+        }
+    }
+}
+
+void World::movePlayer(int dx, int dy, int speed) {
+    if (dx == 0 && dy == 0) return;
+    int new_x = player->x + dx * speed, new_y = player->y + dy * speed;
+    // fuel use stays at 0.25 per 10 px travelled
+    player->setFuel(player->getFuel() - 0.025 * speed);
+    if (new_x >= 0 && new_x <= 660 && new_y >= 0 && new_y <= 640) {
+        int cell_i = new_x / 40;
+        int cell_j = new_y / 40;
+        if (isRoadCell(cell_i, cell_j)) {
+            player->x = new_x;
+            player->y = new_y;
+        } else {
+            player->addScore(-4);
+            gameEvents.push(EVENT_WALL_BUMP, player->x, player->y, -4);
+        }
+    }
+}
+
+// body(begin, end) over [0, count), on the job system if there is one;
+// body may only write to cars and slots in its own range
+static void forEach(JobSystem* jobs, int count, int grain, const function<void(int, int)>& body) {
+    if (jobs) jobs->parallelFor(count, grain, body);
+    else body(0, count);
+}
+
+// World's traffic as laneTick sees it
+struct TrafficCars {
+    vector<OtherCar>& traffic;
+    int x(int i) const { return traffic[i].x; }
+    int y(int i) const { return traffic[i].y; }
+    TrafficMove plan(int i) const { return traffic[i].plan(); }
+    TrafficMove wait(int i, int blocker) const { return traffic[i].wait(traffic[blocker]); }
+    void apply(int i, const TrafficMove& move) { traffic[i].apply(move); }
+};
+
+void World::moveTraffic() {
+    TrafficCars cars = { traffic };
+    laneTick(cars, (int)traffic.size(), lanes, moves, jobs, CARS_PER_JOB);
+}
+
+void World::resolveCollisions() {
+    // 64 cars at a time: positions are packed for the overlap kernel, and each block owns one word of hits
+    int count = (int)traffic.size();
+    int blocks = (count + 63) / 64;
+    hits.resize(blocks);
+    stuck.resize(blocks);
+    forEach(jobs, blocks, CARS_PER_JOB / 64, [this, count](int begin, int end) {
+        int32_t xs[64], ys[64];
+        for (int b = begin; b < end; b++) {
+            int first = b * 64, n = min(64, count - first);
+            for (int k = 0; k < n; k++) {
+                xs[k] = traffic[first + k].x;
+                ys[k] = traffic[first + k].y;
+            }
+            overlapMask(player->x, player->y, 20, 40, xs, ys, n, &hits[b]);
+        }
+    });
+    // Resets use rand() and the lanes, so they stay on this thread, in car order
+    for (int b = 0; b < blocks; b++) {
+        uint64_t stillStuck = 0;
+        for (uint64_t mask = hits[b]; mask; mask &= mask - 1) {
+            int bit = __builtin_ctzll(mask), i = b * 64 + bit;
+            if (!traffic[i].resetPosition(player, lanes, i)) stillStuck |= 1ULL << bit;
+            if (stuck[b] >> bit & 1) continue;
+            player->addScore(-5);
+            gameEvents.push(EVENT_COLLISION, player->x, player->y, -5);
+        }
+        stuck[b] = stillStuck;
+    }
+}
+
+void World::refuel() {
+    for (int i = 0; i < 3; i++) {
+        FuelStation* fs = state.getFuelStation(i);
+        if (fs && abs(player->x - fs->getX()) <= 40 && abs(player->y - fs->getY()) <= 40) {
+            player->refuel();
+            break;
+        }
+    }
+}
+
+void World::pickUpOrDropOff() {
+    if (!player->isCarrying()) {
+        player->pickUp();
+    } else {
+        player->dropOff();
+    }
+}
+
+void World::snapshot(WorldSnapshot& snapshot) const {
+    snapshot.taxi = dynamic_cast<const Taxi*>(player) != nullptr;
+    snapshot.playerColor = player->color;
+    snapshot.player = { player->x, player->y };
+    snapshot.traffic.resize(traffic.size());
+    for (size_t i = 0; i < traffic.size(); i++) snapshot.traffic[i] = { traffic[i].x, traffic[i].y };
+    snapshot.numStations = 0;
+    for (int i = 0; i < 3; i++) {
+        FuelStation* fs = state.getFuelStation(i);
+        if (fs) snapshot.stations[snapshot.numStations++] = { fs->getX(), fs->getY() };
+    }
+    snapshot.numItems = state.getActivePickupItems();
+    for (int i = 0; i < snapshot.numItems; i++) {
+        PickupItem* p = state.getPickupItem(i);
+        snapshot.items[i] = p ? Position{ p->getX(), p->getY() } : Position{ 0, 0 };
+        snapshot.itemActive[i] = p && p->isActive();
+    }
+    const Destination* dest = player->getDestination();
+    snapshot.showDestination = player->isCarrying() && dest && dest->isActive();
+    snapshot.destination = dest ? Position{ dest->getX(), dest->getY() } : Position{ 0, 0 };
+    snapshot.fuel = player->getFuel();
+    snapshot.money = player->getMoney();
+    snapshot.score = player->getScore();
+}
+
+void WorldSnapshot::draw() const {
+    Roads().drawRoads();
+    for (int i = 0; i < numStations; i++) FuelStation(stations[i].x, stations[i].y).draw();
+    for (int i = 0; i < numItems; i++) {
+        if (!itemActive[i]) continue;
+        if (taxi) Passenger(items[i].x, items[i].y).draw();
+        else Box(items[i].x, items[i].y).draw();
+    }
+    if (showDestination) DrawSquare(destination.x, destination.y, 40, colors[GREEN]);
+    drawCarBody(player.x, player.y, playerColor);
+    for (size_t i = 0; i < traffic.size(); i++) drawCarBody(traffic[i].x, traffic[i].y, colors[VIOLET]);
+}
+
+void World::capture(ReplayFrame& frame) const {
+    frame.numCars = min((int)traffic.size() + 1, REPLAY_MAX_CARS);
+    frame.carX[0] = player->x;
+    frame.carY[0] = player->y;
+    for (int i = 1; i < frame.numCars; i++) {
+        frame.carX[i] = traffic[i - 1].x;
+        frame.carY[i] = traffic[i - 1].y;
+    }
+    frame.fuelMilli = (int)lround(player->getFuel() * 1000);
+    frame.money = (int)player->getMoney();
+    frame.score = player->getScore();
+    frame.carrying = player->isCarrying();
+    const Destination* dest = player->getDestination();
+    frame.destActive = dest && dest->isActive();
+    frame.destX = dest ? dest->getX() : 0;
+    frame.destY = dest ? dest->getY() : 0;
+    int numItems = min(state.getActivePickupItems(), REPLAY_MAX_ITEMS);
+    frame.numItems = numItems;
+    for (int i = 0; i < numItems; i++) {
+        PickupItem* p = state.getPickupItem(i);
+        frame.itemX[i] = p ? p->getX() : 0;
+        frame.itemY[i] = p ? p->getY() : 0;
+        frame.itemActive[i] = p && p->isActive();
+    }
+    for (int i = 0; i < REPLAY_STATIONS; i++) {
+        FuelStation* fs = state.getFuelStation(i);
+        frame.stationX[i] = fs ? fs->getX() : 0;
+        frame.stationY[i] = fs ? fs->getY() : 0;
+    }
+}
+
+void World::restore(const ReplayFrame& frame) {
+    player->x = frame.carX[0];
+    player->y = frame.carY[0];
+    player->setFuel(frame.fuelMilli / 1000.0f);
+    player->setMoney(frame.money);
+    player->addScore(frame.score - player->getScore());
+    for (int i = 1; i < frame.numCars && i <= (int)traffic.size(); i++) {
+        traffic[i - 1].x = frame.carX[i];
+        traffic[i - 1].y = frame.carY[i];
+    }
+    lanes.reset(17);
+    for (size_t i = 0; i < traffic.size(); i++) lanes.place((int)i, traffic[i].x, traffic[i].y);
+    for (int i = 0; i < frame.numItems && i < state.getActivePickupItems(); i++) {
+        PickupItem* p = state.getPickupItem(i);
+        if (!p) continue;
+        p->setPosition(frame.itemX[i], frame.itemY[i]);
+        p->setActive(frame.itemActive[i]);
+    }
+}
@@ -0,0 +1,301 @@
+/*
+ * world.h
+ *
+ * The map and everything on it: roads, fuel stations, pickups, the
+ * player's car and traffic. Kept apart from game.cpp so tools such as
+ * the benchmark can build a world and step it without GLUT callbacks
+ * or audio. Drawing still goes through util.h.
+ */
+
+#ifndef WORLD_H_
+#define WORLD_H_
+
+#include "util.h"
+#include "events.h"
+#include "replay.h"
+#include "jobs.h"
+#include "traffic.h"
+#include <cstdint>
+#include <vector>
+using namespace std;
+
+struct Position {
+    int x, y;
+};
+
+class Vehicle {
+public:
+    int x, y;
+    float* color;
+    Vehicle(int startX = 0, int startY = 0, float* startColor = colors[BLACK])
+        : x(startX), y(startY), color(startColor) {}
+    virtual ~Vehicle() {}
+    virtual void move() = 0;
+    virtual void draw() const = 0;
+};
+
+// Body and wheels shared by every car
+void drawCarBody(int x, int y, float* color);
+
+// Cars are 20x40 boxes anchored at their bottom-left corner
+bool collides(const Vehicle& v1, const Vehicle& v2);
+
+// The map is 17x17 cells of 40 px; every fourth row and column is road
+bool isRoadCell(int i, int j);
+Position getRandomRoadPosition();
+// A building cell next to a road that is not in occupied[0..count)
+Position getRandomAdjacentBuildingPosition(const Position* occupied, int count);
+
+class Roads {
+public:
+    void drawRoads() const;
+};
+
+class FuelStation {
+private:
+    int x, y;
+public:
+    FuelStation(int startX, int startY) : x(startX), y(startY) {}
+    void draw() const { DrawSquare(x, y, 40, colors[ORANGE]); }
+    int getX() const { return x; }
+    int getY() const { return y; }
+};
+
+class PickupItem {
+public:
+    virtual ~PickupItem() {}
+    virtual void draw() const = 0;
+    virtual int getX() const = 0;
+    virtual int getY() const = 0;
+    virtual bool isActive() const = 0;
+    virtual void setActive(bool status) = 0;
+    virtual void setPosition(int newX, int newY) = 0;
+};
+
+class Passenger : public PickupItem {
+private:
+    int x, y;
+    bool active;
+public:
+    Passenger(int startX, int startY) : x(startX), y(startY), active(true) {}
+    void draw() const override;
+    int getX() const override { return x; }
+    int getY() const override { return y; }
+    bool isActive() const override { return active; }
+    void setActive(bool status) override { active = status; }
+    void setPosition(int newX, int newY) override { x = newX; y = newY; }
+};
+
+class Box : public PickupItem {
+private:
+    int x, y;
+    bool active;
+public:
+    Box(int startX, int startY) : x(startX), y(startY), active(true) {}
+    void draw() const override { if (active) DrawSquare(x + 10, y + 10, 20, colors[BROWN]); }
+    int getX() const override { return x; }
+    int getY() const override { return y; }
+    bool isActive() const override { return active; }
+    void setActive(bool status) override { active = status; }
+    void setPosition(int newX, int newY) override { x = newX; y = newY; }
+};
+
+class Destination {
+private:
+    int x, y;
+    bool active;
+public:
+    Destination(int startX = 0, int startY = 0) : x(startX), y(startY), active(false) {}
+    void draw() const { if (active) DrawSquare(x, y, 40, colors[GREEN]); }
+    void setPosition(int newX, int newY) { x = newX; y = newY; active = true; }
+    int getX() const { return x; }
+    int getY() const { return y; }
+    bool isActive() const { return active; }
+    void setActive(bool status) { active = status; }
+};
+
+class GameState {
+private:
+    PickupItem* pickupItems[4];
+    int activePickupItems;
+    FuelStation* fuelStations[3];
+public:
+    GameState() : activePickupItems(0) {
+        for (int i = 0; i < 4; i++) pickupItems[i] = nullptr;
+        for (int i = 0; i < 3; i++) fuelStations[i] = nullptr;
+    }
+    ~GameState() {
+        for (int i = 0; i < 4; i++) delete pickupItems[i];
+        for (int i = 0; i < 3; i++) delete fuelStations[i];
+    }
+    void setPickupItem(int index, PickupItem* item) { if (index >= 0 && index < 4) pickupItems[index] = item; }
+    PickupItem* getPickupItem(int index) const { if (index >= 0 && index < 4) return pickupItems[index]; return nullptr; }
+    void setActivePickupItems(int count) { if (count >= 0 && count <= 4) activePickupItems = count; }
+    int getActivePickupItems() const { return activePickupItems; }
+    void setFuelStation(int index, FuelStation* station) { if (index >= 0 && index < 3) fuelStations[index] = station; }
+    FuelStation* getFuelStation(int index) const { if (index >= 0 && index < 3) return fuelStations[index]; return nullptr; }
+};
+
+class PlayerCar : public Vehicle {
+protected:
+    float fuel;
+    float money;
+    int score;
+public:
+    PlayerCar(int startX = 0, int startY = 0, float* startColor = colors[BLACK], float startFuel = 100.0, float startMoney = 0.0)
+        : Vehicle(startX, startY, startColor), fuel(startFuel), money(startMoney), score(0) {}
+    virtual void pickUp() = 0;
+    virtual bool dropOff() = 0;
+    virtual void drawDestination() const {}
+    virtual bool isCarrying() const { return false; }
+    virtual const Destination* getDestination() const { return nullptr; }
+    bool refuel();
+    void move() override {}
+    void draw() const override { drawCarBody(x, y, color); }
+    float getFuel() const { return fuel; }
+    void setFuel(float newFuel) { fuel = newFuel > 0 ? newFuel : 0; }
+    float getMoney() const { return money; }
+    void setMoney(float newMoney) { money = newMoney > 0 ? newMoney : 0; }
+    void addMoney(float amount) { money += amount; if (money < 0) money = 0; }
+    int getScore() const { return score; }
+    void addScore(int points) { score += points; }
+};
+
+class Taxi : public PlayerCar {
+private:
+    bool hasPassenger;
+    Destination* destination;
+    GameState& gameState;
+public:
+    Taxi(int startX, int startY, float* startColor, float startFuel, float startMoney, GameState& gs)
+        : PlayerCar(startX, startY, startColor, startFuel, startMoney), hasPassenger(false), destination(new Destination()), gameState(gs) {}
+    ~Taxi() { delete destination; }
+    void pickUp() override;
+    bool dropOff() override;
+    void drawDestination() const override { if (hasPassenger && destination->isActive()) destination->draw(); }
+    bool hasPassengerStatus() const { return hasPassenger; }
+    bool isCarrying() const override { return hasPassenger; }
+    const Destination* getDestination() const override { return destination; }
+};
+
+class DeliveryCar : public PlayerCar {
+private:
+    bool hasPackage;
+    Destination* destination;
+    GameState& gameState;
+public:
+    DeliveryCar(int startX, int startY, float* startColor, float startFuel, float startMoney, GameState& gs)
+        : PlayerCar(startX, startY, startColor, startFuel, startMoney), hasPackage(false), destination(new Destination()), gameState(gs) {}
+    ~DeliveryCar() { delete destination; }
+    void pickUp() override;
+    bool dropOff() override;
+    void drawDestination() const override { if (hasPackage && destination->isActive()) destination->draw(); }
+    bool hasPackageStatus() const { return hasPackage; }
+    bool isCarrying() const override { return hasPackage; }
+    const Destination* getDestination() const override { return destination; }
+};
+
+class OtherCar : public Vehicle {
+private:
+    int direction;
+    uint32_t seed;          // each car's own random sequence, so cars can move on any thread
+    static const int MOVE_SPEED = 2;
+public:
+    OtherCar(int startX = 42, int startY = 42, float* startColor = colors[GREEN])
+        : Vehicle(startX, startY, startColor), direction(rand() % 4), seed(rand()) {}
+    // Drives straight along the road, turning at random at intersections,
+    // through any car in the way; World::moveTraffic keeps cars apart
+    void move() override;
+    // This tick's move, and the one it makes instead when `blocker` is in the way
+    TrafficMove plan() const;
+    TrafficMove wait(const OtherCar& blocker) const;
+    void apply(const TrafficMove& move);
+    // Respawns on a road cell clear of the player and of the other cars in
+    // lanes, where it is car `index`; stays put and returns false if 64
+    // tries find none.
+    bool resetPosition(const Vehicle* player, LaneGrid& lanes, int index);
+    void draw() const override { drawCarBody(x, y, colors[VIOLET]); }
+};
+
+// What the renderer needs from one tick, copied out of the world so it can
+// be drawn on the main thread while the simulation thread runs the next one
+struct WorldSnapshot {
+    bool taxi;
+    float* playerColor;
+    Position player;
+    vector<Position> traffic;
+    int numStations;
+    Position stations[3];
+    int numItems;
+    Position items[4];
+    bool itemActive[4];
+    bool showDestination;       // carrying, and the destination is active
+    Position destination;
+    float fuel, money;
+    int score;
+
+    WorldSnapshot() : taxi(false), playerColor(colors[BLACK]), player{ 0, 0 }, numStations(0), numItems(0), showDestination(false),
+                      destination{ 0, 0 }, fuel(0), money(0), score(0) {}
+    // Roads, stations, pickups, the destination and every car; not the HUD.
+    void draw() const;
+};
+
+// Starting positions for one game; the player always starts at (0, 640)
+struct WorldLayout {
+    vector<Position> traffic;
+    Position stations[3];
+    int numItems;
+    Position items[4];
+};
+
+// Uses rand(), so the same seed gives the same layout. Traffic cars start
+// on distinct road cells, so there can be at most 144 of them.
+WorldLayout generateWorld(int numTraffic = 4);
+
+// Everything one tick of the game touches. The game, the benchmark and
+// the performance gate all step the simulation through this.
+class World {
+private:
+    vector<uint64_t> hits;      // resolveCollisions: bit i % 64 of hits[i / 64] if traffic[i] touches the player
+    vector<TrafficMove> moves;  // moveTraffic: where each car is going
+    vector<uint64_t> stuck;     // resolveCollisions: cars on the player that found nowhere to respawn, as hits
+public:
+    // Below this many cars per job, handing work to another thread costs more than it saves
+    static const int CARS_PER_JOB = 512;
+    GameState state;
+    PlayerCar* player;
+    vector<OtherCar> traffic;
+    LaneGrid lanes;             // the road cells each of traffic covers; kept up to date by everything here
+    Roads roads;
+    JobSystem* jobs;            // splits traffic work across threads; null runs it all here
+
+    World() : player(nullptr), lanes(17), jobs(nullptr) {}
+    ~World() { delete player; }
+    // Creates the player (taxi or delivery car), traffic, stations and pickups.
+    void populate(const WorldLayout& layout, bool taxi);
+    // Drives the player one step of `speed` pixels in direction (dx, dy),
+    // bumping into buildings; fuel is used either way.
+    void movePlayer(int dx, int dy, int speed);
+    // Moves every traffic car that has room to. Moves are worked out in
+    // parallel and claim their cells in car order, so a car queues behind
+    // the one ahead and the lower-numbered car takes an intersection.
+    void moveTraffic();
+    // Sends every traffic car touching the player elsewhere. Cars are
+    // tested in parallel and handled in order, as on one thread. A car
+    // with nowhere to go tries again next tick, costing the player only
+    // the first time.
+    void resolveCollisions();
+    // Space: refuels when next to a station
+    void refuel();
+    // Enter: picks up if the player is empty, otherwise tries to drop off
+    void pickUpOrDropOff();
+    // Copies what is drawn into snapshot, reusing its traffic vector
+    void snapshot(WorldSnapshot& snapshot) const;
+    // The state a replay keeps; only the first REPLAY_MAX_CARS - 1 traffic cars fit.
+    void capture(ReplayFrame& frame) const;
+    // Puts the player, traffic and pickups where a recorded frame has them.
+    // Whether the player is carrying something is not restored.
+    void restore(const ReplayFrame& frame);
+};
+
+#endif /* WORLD_H_ */